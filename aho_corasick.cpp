@@ -0,0 +1,179 @@
+#include "aho_corasick.hpp"
+
+// Builds the trie directly in the dense table, then resolves every missing
+// transition breadth first: a missing transition of state s on byte class c
+// is the transition of fail(s) on c, which is already complete because
+// fail(s) is shallower than s.
+AhoCorasick::AhoCorasick(const std::vector<std::string> &literals){
+    // Every byte that appears in a literal gets its own column; all the
+    // others share column 0
+    for (const std::string &lit : literals){
+        if (lit.empty()) throw std::runtime_error("Aho-Corasick literals must not be empty");
+        for (char c : lit){
+            unsigned char b = static_cast<unsigned char>(c);
+            if (classes[b] == 0) classes[b] = static_cast<uint16_t>(stride++);
+        }
+    }
+
+    const uint32_t MISSING = std::numeric_limits<uint32_t>::max();
+    table.assign(stride, MISSING);
+    std::vector<std::vector<uint32_t>> own(1);  // literals ending exactly at each state
+    for (size_t i = 0; i < literals.size(); i++){
+        uint32_t s = ROOT;
+        for (char c : literals[i]){
+            uint32_t &next = table[s * stride + classes[static_cast<unsigned char>(c)]];
+            if (next == MISSING){
+                next = static_cast<uint32_t>(own.size());
+                own.emplace_back();
+                table.resize(table.size() + stride, MISSING);
+            }
+            s = table[s * stride + classes[static_cast<unsigned char>(c)]];
+        }
+        own[s].push_back(static_cast<uint32_t>(i));
+        lengths.push_back(static_cast<uint32_t>(literals[i].size()));
+        max_length = std::max(max_length, literals[i].size());
+    }
+    const size_t n = own.size();
+
+    // Failure links, breadth first; outputs of a state include those of its
+    // failure state (literals that end with the same bytes)
+    std::vector<uint32_t> fail(n, ROOT), order;
+    order.reserve(n);
+    for (size_t c = 0; c < stride; c++){
+        uint32_t &next = table[c];
+        if (next == MISSING) next = ROOT;
+        else order.push_back(next);
+    }
+    for (size_t k = 0; k < order.size(); k++){
+        uint32_t s = order[k];
+        for (size_t c = 0; c < stride; c++){
+            uint32_t &next = table[s * stride + c];
+            uint32_t via_fail = table[fail[s] * stride + c];
+            if (next == MISSING){
+                next = via_fail;
+            }else{
+                fail[next] = via_fail;
+                order.push_back(next);
+            }
+        }
+    }
+
+    // Outputs in CSR form. Breadth-first order guarantees the failure state's
+    // list is final before it is merged.
+    std::vector<std::vector<uint32_t>> all(n);
+    for (uint32_t s : order){
+        all[s] = own[s];
+        const std::vector<uint32_t> &inherited = all[fail[s]];
+        all[s].insert(all[s].end(), inherited.begin(), inherited.end());
+        std::sort(all[s].begin(), all[s].end());
+    }
+    out_start.assign(n + 1, 0);
+    for (size_t s = 0; s < n; s++) out_start[s + 1] = out_start[s] + static_cast<uint32_t>(all[s].size());
+    outputs.reserve(out_start[n]);
+    for (size_t s = 0; s < n; s++) outputs.insert(outputs.end(), all[s].begin(), all[s].end());
+}
+
+bool AhoCorasick::find(std::string_view input, Match *m, const Prefilter *pre) const{
+    size_t best_start = std::string_view::npos, best_literal = 0;
+    bool skip = pre && pre->is_active();
+    uint32_t s = ROOT;
+    for (size_t i = 0; i < input.size(); i++){
+        if (skip && s == ROOT && best_start == std::string_view::npos){
+            i = pre->find(input, i);
+            if (i == std::string_view::npos) break;
+        }
+        s = table[s * stride + classes[static_cast<unsigned char>(input[i])]];
+        for (uint32_t k = out_start[s]; k < out_start[s + 1]; k++){
+            uint32_t lit = outputs[k];
+            size_t start = i + 1 - lengths[lit];
+            if (start < best_start || (start == best_start && lit < best_literal)){
+                best_start = start;
+                best_literal = lit;
+            }
+        }
+        // No match that starts at or before best_start can end any later
+        if (best_start != std::string_view::npos && i + 1 >= best_start + max_length) break;
+    }
+
+    if (best_start == std::string_view::npos) return false;
+    if (m) *m = Match{best_literal, best_start, best_start + lengths[best_literal]};
+    return true;
+}
+
+void AhoCorasick::which_occur(std::string_view input, std::vector<bool> &seen, std::vector<uint32_t> &hits) const{
+    uint32_t s = ROOT;
+    for (size_t i = 0; i < input.size() && hits.size() < lengths.size(); i++){
+        s = table[s * stride + classes[static_cast<unsigned char>(input[i])]];
+        for (uint32_t k = out_start[s]; k < out_start[s + 1]; k++){
+            if (seen[outputs[k]]) continue;
+            seen[outputs[k]] = true;
+            hits.push_back(outputs[k]);
+        }
+    }
+}
+
+// Folds the tree into the list of strings each subexpression matches: a
+// literal is one string, concatenation is the product of both lists (in
+// priority order) and alternation appends the second list to the first. Any
+// other node means the pattern is not a literal set.
+bool AhoCorasick::literal_alternatives(const Ast &ast, std::vector<std::string> &out, size_t limit){
+    std::vector<std::vector<std::string>> stack;
+    for (const auto &t : ast.nodes){
+        switch (t.type){
+        case TokenType::LITERAL:
+            stack.push_back({std::string(1, t.literal)});
+            break;
+        case TokenType::LPAREN:
+            stack.push_back({std::string()});
+            break;
+        case TokenType::RPAREN:
+        case TokenType::CONCAT:
+        {
+            if (stack.size() < 2) return false;
+            std::vector<std::string> e2 = std::move(stack.back());
+            stack.pop_back();
+            std::vector<std::string> &e1 = stack.back();
+            if (e1.size() * e2.size() > limit) return false;
+            std::vector<std::string> product;
+            product.reserve(e1.size() * e2.size());
+            for (const std::string &a : e1){
+                for (const std::string &b : e2) product.push_back(a + b);
+            }
+            e1 = std::move(product);
+            break;
+        }
+        case TokenType::ALTERNATION:
+        {
+            if (stack.size() < 2) return false;
+            std::vector<std::string> e2 = std::move(stack.back());
+            stack.pop_back();
+            std::vector<std::string> &e1 = stack.back();
+            if (e1.size() + e2.size() > limit) return false;
+            e1.insert(e1.end(), e2.begin(), e2.end());
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    if (stack.size() != 1) return false;
+
+    // An empty alternative would match everywhere
+    for (const std::string &s : stack[0]){
+        if (s.empty()) return false;
+    }
+    out = std::move(stack[0]);
+    return true;
+}
+
+// Time Complexity Analysis:
+
+// L = total length of the literals, k = number of byte columns (at most 256),
+// n = input length
+
+// Construction:
+// The trie has at most L + 1 states and every one of them gets a full row →
+// O(L * k) time and memory, plus merging the output lists
+
+// find() / which_occur():
+// One table lookup per byte plus the outputs reported → O(n + matches)
@@ -0,0 +1,61 @@
+#ifndef AHO_CORASICK_HPP
+#define AHO_CORASICK_HPP
+#include "ast.hpp"
+#include "prefilter.hpp"
+#include <array>
+
+// Aho-Corasick automaton for a set of literals.
+// The trie and its failure links are compiled into a dense DFA (one row of
+// transitions per trie node, one column per byte class), so scanning costs a
+// single table lookup per input byte and never follows a failure link.
+// Patterns made only of literals (foo|bar|baz) are routed here instead of
+// through the NFA engines.
+//
+// The automaton is immutable once built: all searches are const.
+class AhoCorasick
+{
+public:
+    // Literal i has priority i; literals must not be empty
+    explicit AhoCorasick(const std::vector<std::string> &literals);
+
+    struct Match {
+        size_t literal;     // index of the literal
+        size_t start;
+        size_t end;         // one past the last byte
+    };
+
+    // Leftmost-first search: the match that starts first and, among those,
+    // the literal with the highest priority. 'pre', if given, is used to skip
+    // input while no literal is partially matched.
+    bool find(std::string_view input, Match *m = nullptr, const Prefilter *pre = nullptr) const;
+
+    // Appends to 'hits' every literal that occurs in the input, once, in the
+    // order they are first seen. 'seen' has one entry per literal and must be
+    // all false on entry; on return exactly the entries of 'hits' are set.
+    void which_occur(std::string_view input, std::vector<bool> &seen, std::vector<uint32_t> &hits) const;
+
+    size_t num_literals() const { return lengths.size(); }
+    size_t num_states() const { return table.size() / stride; }
+    size_t memory_usage() const {
+        return (table.size() + out_start.size() + outputs.size() + lengths.size()) * sizeof(uint32_t);
+    }
+
+    // If the pattern only uses literals, concatenation, alternation and
+    // groups, stores every string it matches in 'out', in priority order
+    // (leftmost-first), and returns true. Gives up past 'limit' strings.
+    static bool literal_alternatives(const Ast &ast, std::vector<std::string> &out,
+                                     size_t limit = 1000);
+
+private:
+    static constexpr uint32_t ROOT = 0;
+
+    std::array<uint16_t, 256> classes{};    // byte -> column
+    size_t stride = 1;
+    std::vector<uint32_t> table;            // 'stride' transitions per state
+    std::vector<uint32_t> out_start;        // outputs of state s: outputs[out_start[s] .. out_start[s + 1])
+    std::vector<uint32_t> outputs;          // literals ending at a state, by increasing index
+    std::vector<uint32_t> lengths;          // per literal
+    size_t max_length = 0;
+};
+
+#endif  // AHO_CORASICK_HPP
@@ -0,0 +1,64 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+#include "std.hpp"
+
+// Bump allocator: objects are carved out of large blocks and released all at
+// once by reset(), which only rewinds the cursor (the blocks are kept for the
+// next round). Only meant for trivially destructible objects.
+class Arena
+{
+public:
+    explicit Arena(size_t block_bytes = 16 * 1024) : block_size(block_bytes) {}
+
+    void *allocate(size_t size, size_t align){
+        size_t offset = (align - reinterpret_cast<uintptr_t>(ptr) % align) % align;
+        if (!ptr || offset + size > static_cast<size_t>(end - ptr)){
+            next_block(size + align);
+            offset = (align - reinterpret_cast<uintptr_t>(ptr) % align) % align;
+        }
+        void *result = ptr + offset;
+        ptr += offset + size;
+        return result;
+    }
+
+    template <class T, class... Args>
+    T *make(Args &&...args){
+        static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+
+    // Frees every object in O(1)
+    void reset(){
+        current = 0;
+        ptr = blocks.empty() ? nullptr : blocks[0].data.get();
+        end = blocks.empty() ? nullptr : ptr + blocks[0].size;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    // Moves to the next block that can hold 'min_size' bytes, allocating one if needed
+    void next_block(size_t min_size){
+        size_t next = blocks.empty() ? 0 : current + 1;
+        while (next < blocks.size() && blocks[next].size < min_size) next++;
+        if (next == blocks.size()){
+            // Each new block doubles in size (up to 1024 times the first one)
+            size_t size = std::max(block_size << std::min<size_t>(blocks.size(), 10), min_size);
+            blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        }
+        current = next;
+        ptr = blocks[current].data.get();
+        end = ptr + blocks[current].size;
+    }
+
+    std::vector<Block> blocks;
+    size_t block_size;
+    size_t current = 0;
+    char *ptr = nullptr;
+    char *end = nullptr;
+};
+
+#endif  // ARENA_HPP
@@ -0,0 +1,47 @@
+#ifndef AST_HPP
+#define AST_HPP
+#include "tokenizer.hpp"
+#include <span>
+
+// Ranges of one character class: ranges[first .. first + count) of the table
+// that holds them (Ast::ranges, Program::ranges)
+struct ClassRef {
+    uint32_t first;
+    uint32_t count;
+};
+
+// One node of a syntax tree, typed with the token types. Leaves are LITERAL,
+// DOT, CHAR_CLASS, CARET, DOLLAR and LPAREN (the opening of a group, which
+// matches the empty string). STAR, PLUS, QUESTION and QUANTIFIER_RANGE take
+// one subtree; CONCAT, ALTERNATION and RPAREN (a group: its LPAREN, then its
+// content) take two.
+struct AstNode {
+    TokenType type;
+    bool negated = false;   // CHAR_CLASS
+    char literal = '\0';    // LITERAL
+    uint32_t cls = 0;       // CHAR_CLASS: index into Ast::classes
+    int group_id = -1;      // LPAREN, RPAREN
+    int min = 0;            // QUANTIFIER_RANGE
+    int max = 0;            // QUANTIFIER_RANGE, -1 = unbounded
+};
+
+// A parsed pattern (see Parser).
+// The nodes are stored in postfix order, the order in which every pass that
+// folds the tree bottom-up (NfaBuilder, Prefilter, NfaBuilder::estimate,
+// AhoCorasick::literal_alternatives) reads it with a stack, so a subtree is
+// the run of nodes that ends at its root and the tree needs no pointers.
+// Character classes are interned: each distinct list of ranges is stored once
+// and nodes refer to it by index, in tables laid out like Program's so that
+// NfaBuilder takes them over as they are.
+struct Ast {
+    std::vector<AstNode> nodes;
+    std::vector<CharRange> ranges;
+    std::vector<ClassRef> classes;
+
+    std::span<const CharRange> ranges_of(const AstNode &n) const {
+        const ClassRef &c = classes[n.cls];
+        return {ranges.data() + c.first, c.count};
+    }
+};
+
+#endif  // AST_HPP
@@ -0,0 +1,444 @@
+#include "ast_rewriter.hpp"
+#include "nfa.hpp"
+
+namespace {
+
+bool is_repeat(TokenType t){
+    return t == TokenType::STAR || t == TokenType::PLUS || t == TokenType::QUESTION;
+}
+
+bool is_quantifier(TokenType t){
+    return is_repeat(t) || t == TokenType::QUANTIFIER_RANGE;
+}
+
+// {0,}, {0,1} and {1}, which NfaBuilder expands exactly as it does *, ? and
+// no quantifier at all. x{1,} is not x+: its loop is over a second copy of x,
+// which gives a different answer when x can match the empty string.
+bool is_plain_range(const AstNode &n){
+    return n.type == TokenType::QUANTIFIER_RANGE && (n.min == 0 ? n.max == -1 || n.max == 1 : n.min == 1 && n.max == 1);
+}
+
+unsigned char byte(int c){
+    return static_cast<unsigned char>(c);
+}
+
+}  // namespace
+
+// Most patterns have no alternation and nothing else to rewrite; they are
+// recognised in one pass over the nodes and used as they are
+bool AstRewriter::worth_rewriting(const Ast &ast, bool captures){
+    for (size_t i = 0; i < ast.nodes.size(); i++){
+        const AstNode &n = ast.nodes[i];
+        switch (n.type){
+        case TokenType::ALTERNATION:
+            return true;
+        case TokenType::RPAREN:
+            if (!captures) return true;
+            break;
+        case TokenType::CHAR_CLASS:
+        {
+            std::span<const CharRange> r = ast.ranges_of(n);
+            if (!n.negated && r.size() == 1 && r[0].lo == r[0].hi) return true;
+            break;
+        }
+        default:
+            // A quantifier's operand ends right before it
+            if (is_plain_range(n) || (is_quantifier(n.type) && i > 0 && is_quantifier(ast.nodes[i - 1].type))) return true;
+            break;
+        }
+    }
+    return false;
+}
+
+// Folds the nodes into the working tree the same way NfaBuilder folds them
+// into fragments, rewriting on the way what only needs a node and its
+// operands; alternatives are factored while the tree is written back.
+bool AstRewriter::rewrite(const Ast &ast, bool captures, Ast &result_ast){
+    if (!worth_rewriting(ast, captures)) return false;
+    out = &result_ast;
+    out->nodes.clear();
+    out->ranges = ast.ranges;
+    out->classes = ast.classes;
+    nodes.clear();
+    stack.clear();
+    auto pop = [&](){
+        if (stack.empty()) throw std::runtime_error("Syntax Error: operator is missing an operand");
+        uint32_t id = stack.back();
+        stack.pop_back();
+        return id;
+    };
+
+    for (const AstNode &n : ast.nodes){
+        switch (n.type){
+        case TokenType::LITERAL:
+        case TokenType::DOT:
+        case TokenType::CHAR_CLASS:
+        case TokenType::CARET:
+        case TokenType::DOLLAR:
+        case TokenType::LPAREN:
+            stack.push_back(leaf(n));
+            break;
+        case TokenType::RPAREN:
+        {
+            uint32_t content = pop();
+            pop();  // the LPAREN
+            if (captures){
+                uint32_t group = make(n);
+                nodes[group].first = content;
+                nodes[group].empty = nodes[content].empty;
+                content = group;
+            }
+            stack.push_back(content);
+            break;
+        }
+        case TokenType::CONCAT:
+        case TokenType::ALTERNATION:
+        {
+            uint32_t e2 = pop();
+            uint32_t e1 = pop();
+            stack.push_back(join(n.type, e1, e2));
+            break;
+        }
+        case TokenType::STAR:
+        case TokenType::PLUS:
+        case TokenType::QUESTION:
+        case TokenType::QUANTIFIER_RANGE:
+            stack.push_back(quantify(n, pop()));
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Whatever is left is implicitly concatenated
+    if (stack.empty()) return false;
+    uint32_t root = stack[0];
+    for (size_t i = 1; i < stack.size(); i++) root = join(TokenType::CONCAT, root, stack[i]);
+    emit(root);
+    return true;
+}
+
+uint32_t AstRewriter::make(const AstNode &n){
+    nodes.push_back(Node{n});
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+// [c] is the literal c. An anchor matches the empty string wherever it
+// matches at all.
+uint32_t AstRewriter::leaf(const AstNode &n){
+    if (n.type == TokenType::CHAR_CLASS && !n.negated){
+        const ClassRef &c = out->classes[n.cls];
+        if (c.count == 1 && out->ranges[c.first].lo == out->ranges[c.first].hi){
+            AstNode literal{TokenType::LITERAL};
+            literal.literal = out->ranges[c.first].lo;
+            return make(literal);
+        }
+    }
+    uint32_t id = make(n);
+    nodes[id].empty = n.type == TokenType::CARET || n.type == TokenType::DOLLAR;
+    return id;
+}
+
+// e1 e2 or e1|e2, appended to the children of 'e1' (and taking over those of
+// 'e2') when it already is one: both operators are associative
+uint32_t AstRewriter::join(TokenType op, uint32_t e1, uint32_t e2){
+    uint32_t list = e1;
+    if (nodes[e1].ast.type != op){
+        list = make(AstNode{op});
+        nodes[list].first = nodes[list].last = e1;
+        nodes[list].empty = nodes[e1].empty;
+    }
+    if (op == TokenType::CONCAT) nodes[list].empty = nodes[list].empty && nodes[e2].empty;
+    else nodes[list].empty = nodes[list].empty || nodes[e2].empty;
+    if (nodes[e2].ast.type == op){
+        nodes[nodes[list].last].next = nodes[e2].first;
+        nodes[list].last = nodes[e2].last;
+    }else{
+        nodes[nodes[list].last].next = e2;
+        nodes[list].last = e2;
+        nodes[e2].next = NONE;
+    }
+    return list;
+}
+
+uint32_t AstRewriter::quantify(const AstNode &q, uint32_t e){
+    AstNode op = q;
+    if (is_plain_range(op)){
+        if (op.min == 1 && op.max == 1) return e;
+        op.type = op.max == 1 ? TokenType::QUESTION : TokenType::STAR;
+    }
+    TokenType inner = nodes[e].ast.type;
+    if (is_repeat(op.type) && is_repeat(inner) && !nodes[nodes[e].first].empty){
+        if (inner != op.type) nodes[e].ast.type = TokenType::STAR;
+        nodes[e].empty = nodes[e].ast.type != TokenType::PLUS;
+        return e;
+    }
+    uint32_t id = make(op);
+    nodes[id].first = e;
+    nodes[id].empty = op.type == TokenType::STAR || op.type == TokenType::QUESTION ||
+                      (op.type == TokenType::QUANTIFIER_RANGE && op.min == 0) || nodes[e].empty;
+    return id;
+}
+
+uint32_t AstRewriter::factor(uint32_t alt){
+    items.clear();
+    for (uint32_t c = nodes[alt].first; c != NONE; c = nodes[c].next) items.push_back(c);
+    share_ends(false);
+    share_ends(true);
+    merge_chars();
+    if (items.size() == 1) return items[0];
+
+    nodes[alt].first = items[0];
+    for (size_t i = 0; i + 1 < items.size(); i++) nodes[items[i]].next = items[i + 1];
+    nodes[items.back()].next = NONE;
+    nodes[alt].last = items.back();
+    return alt;
+}
+
+// Factors the atoms that runs of adjacent alternatives start with (end with,
+// if 'suffix') out of them: x a | x b -> x (a|b). Every alternative keeps at
+// least one part, so none of them becomes empty. The new alternation is
+// factored in turn when it is written out.
+void AstRewriter::share_ends(bool suffix){
+    flat.clear();
+    begin.clear();
+    for (uint32_t item : items){
+        begin.push_back(flat.size());
+        if (nodes[item].ast.type != TokenType::CONCAT){
+            flat.push_back(item);
+            continue;
+        }
+        for (uint32_t c = nodes[item].first; c != NONE; c = nodes[c].next) flat.push_back(c);
+    }
+    begin.push_back(flat.size());
+    auto length = [&](size_t i){ return begin[i + 1] - begin[i]; };
+    // Part k of alternative i, counted from the end that is shared
+    auto at = [&](size_t i, size_t k){ return suffix ? flat[begin[i + 1] - 1 - k] : flat[begin[i] + k]; };
+
+    result.clear();
+    for (size_t i = 0, j; i < items.size(); i = j){
+        j = i + 1;
+        if (length(i) >= 2 && is_atom(at(i, 0))){
+            while (j < items.size() && length(j) >= 2 && same_atom(at(j, 0), at(i, 0))) j++;
+        }
+        if (j - i == 1){
+            result.push_back(items[i]);
+            continue;
+        }
+
+        size_t shared = 1, most = length(i) - 1;
+        for (size_t k = i + 1; k < j; k++) most = std::min(most, length(k) - 1);
+        auto agree = [&](size_t p){
+            if (!is_atom(at(i, p))) return false;
+            for (size_t k = i + 1; k < j; k++){
+                if (!same_atom(at(k, p), at(i, p))) return false;
+            }
+            return true;
+        };
+        while (shared < most && agree(shared)) shared++;
+
+        // The first alternative's copy of the shared part stands for all of them
+        uint32_t rest = NONE;
+        for (size_t k = i; k < j; k++){
+            uint32_t e = suffix ? sequence(begin[k], begin[k + 1] - shared) : sequence(begin[k] + shared, begin[k + 1]);
+            rest = rest == NONE ? e : join(TokenType::ALTERNATION, rest, e);
+        }
+        uint32_t common = suffix ? sequence(begin[i + 1] - shared, begin[i + 1]) : sequence(begin[i], begin[i] + shared);
+        result.push_back(suffix ? join(TokenType::CONCAT, rest, common) : join(TokenType::CONCAT, common, rest));
+    }
+    items.swap(result);
+}
+
+// Turns each run of adjacent one-character alternatives into one of them.
+// A merged class may take no more room in the program than the states it
+// replaces (a SPLIT and a consuming state per alternative merged away), so
+// the program stays within NfaBuilder::estimate() of the original pattern.
+void AstRewriter::merge_chars(){
+    result.clear();
+    for (size_t i = 0, j; i < items.size(); i = j){
+        j = i + 1;
+        if (is_char(items[i])){
+            while (j < items.size() && is_char(items[j])) j++;
+        }
+        if (j - i >= 2){
+            std::bitset<256> bytes;
+            for (size_t k = i; k < j; k++) bytes |= bytes_of(nodes[items[k]].ast);
+            AstNode merged{TokenType::CHAR_CLASS};
+            if (set_bytes(merged, bytes, 2 * (j - i - 1) * sizeof(State))){
+                result.push_back(make(merged));
+                continue;
+            }
+        }
+        result.insert(result.end(), items.begin() + static_cast<std::ptrdiff_t>(i), items.begin() + static_cast<std::ptrdiff_t>(j));
+    }
+    items.swap(result);
+}
+
+// The parts flat[from .. to) in a row
+uint32_t AstRewriter::sequence(size_t from, size_t to){
+    if (to - from == 1) return flat[from];
+    uint32_t list = make(AstNode{TokenType::CONCAT});
+    nodes[list].first = flat[from];
+    for (size_t k = from; k + 1 < to; k++) nodes[flat[k]].next = flat[k + 1];
+    nodes[flat[to - 1]].next = NONE;
+    nodes[list].last = flat[to - 1];
+    return list;
+}
+
+bool AstRewriter::is_char(uint32_t id) const{
+    TokenType t = nodes[id].ast.type;
+    return t == TokenType::LITERAL || t == TokenType::DOT || t == TokenType::CHAR_CLASS;
+}
+
+bool AstRewriter::is_atom(uint32_t id) const{
+    TokenType t = nodes[id].ast.type;
+    return is_char(id) || t == TokenType::CARET || t == TokenType::DOLLAR;
+}
+
+bool AstRewriter::same_atom(uint32_t a, uint32_t b) const{
+    const AstNode &x = nodes[a].ast, &y = nodes[b].ast;
+    if (x.type != y.type || !is_atom(a)) return false;
+    switch (x.type){
+    case TokenType::LITERAL:
+        return x.literal == y.literal;
+    case TokenType::CHAR_CLASS:
+    {
+        if (x.negated != y.negated) return false;
+        if (x.cls == y.cls) return true;
+        std::span<const CharRange> rx = out->ranges_of(x), ry = out->ranges_of(y);
+        return std::equal(rx.begin(), rx.end(), ry.begin(), ry.end(),
+                          [](const CharRange &l, const CharRange &r){ return l.lo == r.lo && l.hi == r.hi; });
+    }
+    default:
+        return true;
+    }
+}
+
+// The bytes a LITERAL, DOT or CHAR_CLASS accepts, as Program::accepts() has them
+std::bitset<256> AstRewriter::bytes_of(const AstNode &n) const{
+    std::bitset<256> bytes;
+    switch (n.type){
+    case TokenType::LITERAL:
+        bytes.set(byte(n.literal));
+        break;
+    case TokenType::DOT:
+        bytes.set();
+        bytes.reset('\n');
+        break;
+    case TokenType::CHAR_CLASS:
+        for (const CharRange &r : out->ranges_of(n)){
+            for (int c = r.lo; c <= r.hi; c++) bytes.set(byte(c));
+        }
+        if (n.negated) bytes.flip();
+        break;
+    default:
+        break;
+    }
+    return bytes;
+}
+
+// Makes 'n' the simplest node that accepts exactly 'bytes': a literal, '.',
+// or a class of the bytes (or of the others, negated, if that takes fewer
+// ranges). A new class is only added if it fits in 'budget' bytes; returns
+// false if it does not.
+bool AstRewriter::set_bytes(AstNode &n, const std::bitset<256> &bytes, size_t budget){
+    std::bitset<256> dot;
+    dot.set();
+    dot.reset('\n');
+    if (bytes.count() == 1){
+        n.type = TokenType::LITERAL;
+        for (int c = CHAR_MIN; c <= CHAR_MAX; c++){
+            if (bytes[byte(c)]) n.literal = static_cast<char>(c);
+        }
+        return true;
+    }
+    if (bytes == dot){
+        n.type = TokenType::DOT;
+        return true;
+    }
+
+    // Ranges are compared as char, so they are collected in that order
+    auto collect = [&](bool in){
+        ranges.clear();
+        for (int c = CHAR_MIN; c <= CHAR_MAX; c++){
+            if (bytes[byte(c)] != in) continue;
+            if (!ranges.empty() && ranges.back().hi == c - 1) ranges.back().hi = static_cast<char>(c);
+            else ranges.push_back({static_cast<char>(c), static_cast<char>(c)});
+        }
+    };
+    collect(false);
+    size_t outside = ranges.size();
+    collect(true);
+    n.negated = outside < ranges.size();
+    if (n.negated) collect(false);
+    if (sizeof(ClassRef) + ranges.size() * sizeof(CharRange) > budget) return false;
+
+    n.type = TokenType::CHAR_CLASS;
+    n.cls = static_cast<uint32_t>(out->classes.size());
+    out->classes.push_back({static_cast<uint32_t>(out->ranges.size()), static_cast<uint32_t>(ranges.size())});
+    out->ranges.insert(out->ranges.end(), ranges.begin(), ranges.end());
+    return true;
+}
+
+// Writes the subtree back in postfix order, binary operators associating to
+// the left as the Parser has them
+void AstRewriter::emit(uint32_t id){
+    if (nodes[id].ast.type == TokenType::ALTERNATION) id = factor(id);
+    const AstNode n = nodes[id].ast;
+    switch (n.type){
+    case TokenType::CONCAT:
+    case TokenType::ALTERNATION:
+        for (uint32_t c = nodes[id].first; c != NONE; c = nodes[c].next){
+            emit(c);
+            if (c != nodes[id].first) out->nodes.push_back(AstNode{n.type});
+        }
+        break;
+    case TokenType::RPAREN:
+    {
+        AstNode lparen{TokenType::LPAREN};
+        lparen.group_id = n.group_id;
+        out->nodes.push_back(lparen);
+        emit(nodes[id].first);
+        out->nodes.push_back(n);
+        break;
+    }
+    case TokenType::STAR:
+    case TokenType::PLUS:
+    case TokenType::QUESTION:
+    case TokenType::QUANTIFIER_RANGE:
+        emit(nodes[id].first);
+        out->nodes.push_back(n);
+        break;
+    default:
+        out->nodes.push_back(n);
+        break;
+    }
+}
+
+// Time Complexity Analysis:
+
+// T = number of nodes, a = number of alternatives in the pattern
+
+// worth_rewriting():
+// One pass over the nodes → O(T)
+
+// Building the working tree:
+// O(1) per node; concatenations and alternations are flattened by splicing
+// child lists → O(T)
+
+// factor():
+// Lists the parts of every alternative twice and compares each part at most
+// once per neighbouring alternative → O(parts). Factoring nests: the new
+// alternation is factored again when written out, so a part is listed once
+// per level of sharing above it, at most the length of its alternative →
+// O(T * a) over a whole pattern in the worst case, O(T) when alternatives
+// share at most one prefix and one suffix.
+// Merging one-character alternatives is O(256) per class.
+
+// emit():
+// O(1) per node of the rewritten tree, which has no more nodes than the
+// original → O(T)
+
+// Memory:
+// The working tree (a few words per node), the rewritten tree and one copy
+// of the pattern's class tables.
@@ -0,0 +1,86 @@
+#ifndef AST_REWRITER_HPP
+#define AST_REWRITER_HPP
+#include "ast.hpp"
+#include <bitset>
+
+// Rewrites a parsed pattern into a smaller one that matches the same strings,
+// found with the same leftmost-first priorities, before any state is built:
+//
+// - x{0,}, x{0,1} and x{1} become x*, x? and x
+// - a quantifier applied straight to another one is folded into it when x
+//   cannot match the empty string: x** is x*, x++ is x+, x?? is x? and any
+//   other pair of *, + and ? is x*
+// - adjacent alternatives that start with the same characters share them,
+//   abc|abd -> ab(c|d), and so do those that end with the same characters
+// - adjacent alternatives that each match one character become one class,
+//   a|b|[0-9] -> [ab0-9] (so ab(c|d) -> ab[cd]), and a class of one
+//   character becomes a literal
+//
+// Only single characters and anchors are factored out of alternatives: they
+// match in exactly one way, so the matches of the alternatives are still
+// tried in the same order. Loops over something that can match the empty
+// string are left alone: the engines cut them where they come back to a
+// state they are still expanding, and the answer depends on where that is.
+//
+// When captures are wanted groups are kept as they are and nothing is folded
+// through them; otherwise they are dropped first, so that (a+)* -> a* and
+// (a)|(b) -> [ab].
+//
+// The rewritten tree never needs more than NfaBuilder::estimate() says for
+// the original, so limits checked against the original still hold.
+class AstRewriter
+{
+public:
+    // Writes the rewritten tree to 'out' and returns true, or returns false
+    // (leaving 'out' alone) if there is nothing to rewrite. The working tree
+    // is kept for the next call.
+    bool rewrite(const Ast &ast, bool captures, Ast &out);
+
+private:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    // One node of the working tree. CONCAT and ALTERNATION have any number of
+    // children, linked through 'next'; RPAREN is a whole group and has its
+    // content as only child, like the quantifiers.
+    struct Node {
+        AstNode ast;
+        uint32_t first = NONE;
+        uint32_t last = NONE;   // CONCAT, ALTERNATION
+        uint32_t next = NONE;
+        bool empty = false;     // can match the empty string
+    };
+
+    static bool worth_rewriting(const Ast &ast, bool captures);
+
+    uint32_t make(const AstNode &n);
+    uint32_t leaf(const AstNode &n);
+    uint32_t join(TokenType op, uint32_t e1, uint32_t e2);
+    uint32_t quantify(const AstNode &q, uint32_t e);
+
+    // What an alternation becomes once its alternatives are factored and
+    // merged
+    uint32_t factor(uint32_t alt);
+    void share_ends(bool suffix);
+    void merge_chars();
+    uint32_t sequence(size_t from, size_t to);
+
+    // Single characters and anchors, the atoms that may be factored
+    bool is_atom(uint32_t id) const;
+    bool is_char(uint32_t id) const;
+    bool same_atom(uint32_t a, uint32_t b) const;
+    std::bitset<256> bytes_of(const AstNode &n) const;
+    bool set_bytes(AstNode &n, const std::bitset<256> &bytes, size_t budget);
+
+    void emit(uint32_t id);
+
+    Ast *out = nullptr;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> items;    // factor(): the alternatives
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> flat;     // share_ends(): the parts of every alternative
+    std::vector<size_t> begin;      // ... alternative i is flat[begin[i] .. begin[i + 1])
+    std::vector<CharRange> ranges;
+};
+
+#endif  // AST_REWRITER_HPP
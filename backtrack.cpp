@@ -0,0 +1,136 @@
+#include "backtrack.hpp"
+
+Backtracker::Backtracker(const Program &p, size_t max_visited_bits)
+    : prog(p), pairs(p), max_bits(max_visited_bits), slots(p.num_slots, NO_POS) {}
+
+bool Backtracker::can_run(size_t input_length) const{
+    return input_length < max_bits && pairs.size() <= max_bits / (input_length + 1);
+}
+
+bool Backtracker::match(std::string_view input, Captures *caps){
+    return run(input, true, caps);
+}
+
+bool Backtracker::search(std::string_view input, Captures *caps){
+    return run(input, false, caps);
+}
+
+// Tries every start position in order (only position 0 when anchored); the
+// visited bits are shared by all of them, since a (state, position) pair that
+// failed for an earlier start fails for a later one too.
+bool Backtracker::run(std::string_view input, bool anchored, Captures *caps){
+    if (!can_run(input.size())) throw std::runtime_error("input is too long for the backtracker");
+    if (!prog.prefilter.may_match(input)) return false;
+
+    size_t bits = pairs.size() * (input.size() + 1);
+    visited.assign((bits + 63) / 64, 0);
+    bool skip = !anchored && prog.prefilter.is_active();
+
+    for (size_t start = 0; start <= input.size(); start++){
+        if (skip){
+            start = prog.prefilter.find(input, start);
+            if (start == std::string_view::npos) break;
+        }
+        std::fill(slots.begin(), slots.end(), NO_POS);
+        if (backtrack(input, start, anchored)){
+            slots[0] = start;
+            if (caps) caps->assign(slots.begin(), slots.end());
+            return true;
+        }
+        if (anchored) break;
+    }
+    return false;
+}
+
+// Depth-first search from the program's start at 'start'. On success the
+// match end is in slots[1] and the groups in the other registers.
+bool Backtracker::backtrack(std::string_view input, size_t start, bool anchored){
+    const size_t cols = input.size() + 1;
+    stack.push_back({prog.start, 0, start, NO_POS, 0});
+    while (!stack.empty()){
+        Job j = stack.back();
+        stack.pop_back();
+        if (j.slot != NO_POS){   // Restore a register saved by a SAVE state
+            slots[j.slot] = j.old;
+            continue;
+        }
+
+        StateId id = j.s;
+        uint32_t count = j.count;
+        size_t pos = j.pos;
+        while (id != NO_STATE){
+            size_t bit = pairs(id, count) * cols + pos;
+            if (visited[bit / 64] & (uint64_t(1) << (bit % 64))) break;
+            visited[bit / 64] |= uint64_t(1) << (bit % 64);
+
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+                stack.push_back({curr.out1, count, pos, NO_POS, 0});
+                id = curr.out;
+                break;
+            case StateType::SAVE:
+            {
+                size_t slot = static_cast<size_t>(curr.save_id);
+                stack.push_back({NO_STATE, 0, 0, slot, slots[slot]});
+                slots[slot] = pos;
+                id = curr.out;
+                break;
+            }
+            case StateType::REPEAT:
+            {
+                // See PikeVM::add_thread()
+                const Counter &k = prog.counters[curr.counter];
+                bool again = k.max == -1 || count < static_cast<uint32_t>(k.max);
+                if (count >= static_cast<uint32_t>(k.min)){
+                    if (!again){
+                        id = curr.out1;
+                        count = 0;
+                        break;
+                    }
+                    stack.push_back({curr.out1, 0, pos, NO_POS, 0});
+                }
+                id = curr.out;
+                break;
+            }
+            case StateType::NEXT:
+                count = std::min(count + 1, prog.counters[curr.counter].limit());
+                id = curr.out;
+                break;
+            case StateType::ANCHOR_START:
+                id = (pos == 0) ? curr.out : NO_STATE;
+                break;
+            case StateType::ANCHOR_END:
+                id = (pos == input.size()) ? curr.out : NO_STATE;
+                break;
+            case StateType::MATCH:
+                if (anchored && pos != input.size()){
+                    id = NO_STATE;
+                    break;
+                }
+                slots[1] = pos;
+                stack.clear();
+                return true;
+            default:    // CHAR, DOT, CHAR_CLASS
+                if (pos < input.size() && prog.accepts(curr, input[pos])){
+                    id = curr.out;
+                    pos++;
+                }else{
+                    id = NO_STATE;
+                }
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states (of (state, count) pairs with
+// counted loops), k = number of capture registers
+
+// run():
+// Every (state, position) pair is explored at most once over all start
+// positions → O(n * m) steps, plus O(m * n / 64) to clear the bitset and
+// O(k) per start position to reset the registers
@@ -0,0 +1,57 @@
+#ifndef BACKTRACK_HPP
+#define BACKTRACK_HPP
+#include "nfa.hpp"
+#include "match.hpp"
+
+// Bounded backtracking over the NFA program, for short inputs with captures.
+// Branches are explored depth first in priority order ('out' before 'out1'),
+// so the first MATCH reached is the leftmost-first match, and the capture
+// registers are a single array instead of one copy per thread. A visited
+// bitset over (state, position) pairs makes sure no pair is explored twice:
+// a pair that failed once fails again, whatever the captures are. That keeps
+// the worst case at O(n * m) instead of exponential, but costs m * (n + 1)
+// bits, so the engine only takes inputs for which that fits the budget.
+// Counted loops (see Counter) are followed like the Pike VM follows them,
+// with m the number of (state, count) pairs (see CountedStates), so a large
+// count leaves the backtracker only short inputs.
+//
+// The program is only read; it must outlive the backtracker.
+class Backtracker
+{
+public:
+    static constexpr size_t DEFAULT_MAX_VISITED_BITS = 256 * 1024 * 8;  // 256 KiB
+
+    explicit Backtracker(const Program &prog, size_t max_visited_bits = DEFAULT_MAX_VISITED_BITS);
+
+    // True if an input of this length fits the visited budget
+    bool can_run(size_t input_length) const;
+
+    // Same results as PikeVM::match and PikeVM::search.
+    // Throws std::runtime_error if the input does not fit the budget.
+    bool match(std::string_view input, Captures *caps = nullptr);
+    bool search(std::string_view input, Captures *caps = nullptr);
+
+private:
+    // Pending work: a state to explore at a position, or a capture register
+    // to restore once a branch has been fully explored
+    struct Job {
+        StateId s;
+        uint32_t count;
+        size_t pos;
+        size_t slot;
+        size_t old;
+    };
+
+    bool run(std::string_view input, bool anchored, Captures *caps);
+    bool backtrack(std::string_view input, size_t start, bool anchored);
+
+    const Program &prog;
+    const CountedStates pairs;
+    size_t max_bits;
+
+    std::vector<uint64_t> visited;  // bit pairs(s, count) * (n + 1) + pos
+    std::vector<size_t> slots;
+    std::vector<Job> stack;
+};
+
+#endif  // BACKTRACK_HPP
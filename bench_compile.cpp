@@ -0,0 +1,149 @@
+#include<iostream>
+#include<vector>
+#include<chrono>
+#include<new>
+#include"nfa_builder.hpp"
+#include"test_patterns.hpp"
+
+// Benchmark: parsing and NFA construction time and heap allocations per
+// compiled pattern over the testing.cpp corpus, plus a few large counted
+// repetitions, which are also timed on their own, expanded and as counted
+// loops
+
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+
+void* operator new(std::size_t size){
+    alloc_count++;
+    alloc_bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+int main(){
+    const std::vector<std::string> large = {"a{1000}", "(abc){1000}", "[a-z]{2,500}", "(a|b){100,200}",
+                                            "((a{10}){10}){10}", ".{0,4096}"};
+    std::vector<std::string> patterns = TEST_PATTERNS;
+    patterns.insert(patterns.end(), large.begin(), large.end());
+
+    // Parse up front: the parser and NfaBuilder::build are measured apart
+    std::vector<std::string> valid;
+    std::vector<Ast> asts;
+    for (const auto& p : patterns){
+        try{
+            asts.push_back(Parser::parse(p));
+            valid.push_back(p);
+        }catch (const std::exception&){
+            // invalid patterns of the corpus are skipped
+        }
+    }
+
+    const int rounds = 50;
+    size_t nodes = 0;
+    size_t parse_allocs_before = alloc_count, parse_bytes_before = alloc_bytes;
+    auto parse_start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < rounds; r++){
+        for (const auto& p : valid) nodes += Parser::parse(p).nodes.size();
+    }
+    auto parse_end = std::chrono::high_resolution_clock::now();
+    double parses = static_cast<double>(rounds * valid.size());
+    double parse_us = std::chrono::duration<double, std::micro>(parse_end - parse_start).count();
+    double parse_allocs = static_cast<double>(alloc_count - parse_allocs_before) / parses;
+    double parse_bytes = static_cast<double>(alloc_bytes - parse_bytes_before) / parses;
+
+    NfaBuilder nb;
+    size_t states = 0;
+    size_t allocs_before = alloc_count, bytes_before = alloc_bytes;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < rounds; r++){
+        for (const auto& ast : asts){
+            Program prog = nb.build(ast);
+            states += prog.size();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    size_t builds = rounds * asts.size();
+    double us = std::chrono::duration<double, std::micro>(end - start).count();
+
+    std::cout << "patterns:          " << asts.size() << " (x" << rounds << " rounds)\n";
+    std::cout << "nodes per round:   " << nodes / rounds << "\n";
+    std::cout << "time per parse:    " << parse_us / parses << " us\n";
+    std::cout << "allocs per parse:  " << parse_allocs << "\n";
+    std::cout << "bytes per parse:   " << parse_bytes << "\n";
+    std::cout << "states per round:  " << states / rounds << "\n";
+    std::cout << "time per build:    " << us / static_cast<double>(builds) << " us\n";
+    std::cout << "allocs per build:  " << static_cast<double>(alloc_count - allocs_before) / static_cast<double>(builds) << "\n";
+    std::cout << "bytes per build:   " << static_cast<double>(alloc_bytes - bytes_before) / static_cast<double>(builds) << "\n";
+
+    // The large counted repetitions on their own, expanded and with counters
+    for (const auto& p : large){
+        Ast ast = Parser::parse(p);
+        std::cout << p << ":";
+        for (bool counters : {false, true}){
+            size_t size = 0;
+            auto large_start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < rounds; r++) size = nb.build(ast, true, counters).size();
+            auto large_end = std::chrono::high_resolution_clock::now();
+            std::cout << " " << std::chrono::duration<double, std::micro>(large_end - large_start).count() / rounds
+                      << " us (" << size << " states)";
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+// Results (g++ 12, -O2, Linux x86-64), 204 buildable patterns (the testing
+// corpus and the large repetitions) x 50 rounds, median of three runs:
+//
+// time per parse       0.30 us
+// allocs per parse     4.3
+// bytes per parse      308
+// states per round     17946       (8193 of them .{0,4096})
+// time per build       4.5 us
+// allocs per build     18.9
+// bytes per build      2626
+//
+//                      expanded                counters
+// a{1000}              42 us  (1001 states)    18.6 us (4 states)
+// (abc){1000}          92 us  (5001 states)    20.6 us (8 states)
+// [a-z]{2,500}         28 us  (999 states)     1.6 us  (4 states)
+// (a|b){100,200}       20 us  (701 states)     20 us   (701 states)
+// ((a{10}){10}){10}    28 us  (1221 states)    26 us   (1221 states)
+// .{0,4096}            210 us (8193 states)    1.0 us  (4 states)
+//
+// A build is the whole of NfaBuilder::build(): AstRewriter, the Thompson
+// construction, NfaOptimizer, byte classes and prefilter. The corpus is
+// built without counters, as every program was before them. With counters,
+// a repetition of more than NfaBuilder::MAX_COPIES instances is one counted
+// loop whatever its count; the smaller ones are still expanded, which is why
+// (a|b){100,200} and ((a{10}){10}){10} cost the same both ways. What a{1000}
+// and (abc){1000} still spend goes to reading the literal out of the tree
+// for the prefilter. Timings are from a busier machine than the ones the
+// commit messages of the earlier parser and builder changes quote.
+
+// Arena and block copies, before and after. The builder took postfix tokens
+// then, so this comparison runs the harness of that change on the trees on
+// both sides of it: build() alone over the same corpus and the first five
+// large patterns, on one machine, median of three runs:
+//
+//                      before                 after
+//                      (heap Frag exits,      (arena Frag exits, block
+//                      hash-map copies)       copies, presized program)
+// states per round     10399                  10215
+// time per build       7.4 us                 0.79 us
+// allocs per build     212.3                  4.7
+// bytes per build      15954                  917
+//
+// To reproduce, from the root of the repository:
+// c=$(git log --diff-filter=A --format=%h -- arena.hpp)
+// mkdir before after
+// git archive $c^ | tar -x -C before && git archive $c | tar -x -C after
+// cp after/bench_compile.cpp after/test_patterns.hpp before/
+// then in each of before/ and after/:
+// g++ -std=c++20 -O2 bench_compile.cpp tokenizer.cpp postfix.cpp nfa_builder.cpp -o bench_compile.exe
+
+// compile and run the file:
+// g++ -std=c++20 -O2 bench_compile.cpp tokenizer.cpp parser.cpp ast_rewriter.cpp nfa_builder.cpp nfa_optimizer.cpp byte_classes.cpp prefilter.cpp -o bench_compile.exe
+// .\bench_compile.exe
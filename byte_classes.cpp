@@ -0,0 +1,66 @@
+#include "byte_classes.hpp"
+#include "nfa.hpp"
+
+std::vector<unsigned char> ByteClasses::representatives() const{
+    std::vector<unsigned char> reps(count);
+    for (int b = 255; b >= 0; b--) reps[map[b]] = static_cast<unsigned char>(b);
+    return reps;
+}
+
+// Every consuming state accepts a union of byte ranges, so it is enough to
+// cut the alphabet wherever one of those ranges starts or ends: each class is
+// then a run of consecutive bytes that no state can split. This is not always
+// the coarsest partition ([ac] gives 'a', 'b' and 'c' their own classes) but
+// it only costs one mark per range.
+ByteClasses ByteClasses::compute(const Program &prog){
+    // boundary[b]: a class ends at byte b
+    std::array<bool, 256> boundary{};
+    auto mark_range = [&](char lo, char hi){
+        unsigned char l = static_cast<unsigned char>(lo), h = static_cast<unsigned char>(hi);
+        if (l > 0) boundary[l - 1] = true;
+        boundary[h] = true;
+        // A range that crosses from negative to positive chars wraps around
+        // 0xFF -> 0x00, which is a boundary anyway
+    };
+
+    for (const State &s : prog.states){
+        switch (s.type){
+        case StateType::CHAR:
+            mark_range(s.c, s.c);
+            break;
+        case StateType::DOT:
+            mark_range('\n', '\n');
+            break;
+        case StateType::CHAR_CLASS: {
+            // Negation does not move the boundaries
+            const ClassRef &cr = prog.classes[s.cls];
+            for (uint32_t k = cr.first; k < cr.first + cr.count; k++){
+                mark_range(prog.ranges[k].lo, prog.ranges[k].hi);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Fill the map one run at a time
+    ByteClasses result;
+    boundary[255] = true;
+    uint16_t k = 0;
+    size_t run = 0;
+    for (size_t b = 0; b < 256; b++){
+        if (!boundary[b]) continue;
+        std::fill(result.map.begin() + static_cast<std::ptrdiff_t>(run), result.map.begin() + static_cast<std::ptrdiff_t>(b) + 1, static_cast<uint8_t>(k++));
+        run = b + 1;
+    }
+    result.count = k;
+    return result;
+}
+
+// Time Complexity Analysis:
+
+// m = number of states, r = total number of class ranges
+
+// compute():
+// One mark per state or range, then one pass over the alphabet → O(m + r + 256)
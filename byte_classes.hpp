@@ -0,0 +1,26 @@
+#ifndef BYTE_CLASSES_HPP
+#define BYTE_CLASSES_HPP
+#include "std.hpp"
+#include <array>
+
+struct Program;
+
+// Partition of the 256 byte values into equivalence classes: two bytes share
+// a class when no state of the program can tell them apart. Automata index
+// their transition tables by class instead of by byte, so a table row has
+// 'count' columns instead of 256.
+struct ByteClasses {
+    std::array<uint8_t, 256> map{};     // byte -> class
+    uint16_t count = 1;                 // number of classes (1 to 256)
+
+    uint8_t operator[](unsigned char b) const { return map[b]; }
+
+    // Some byte of every class, indexed by class
+    std::vector<unsigned char> representatives() const;
+
+    // Computes the coarsest partition that respects every CHAR, DOT and
+    // CHAR_CLASS state of 'prog'
+    static ByteClasses compute(const Program &prog);
+};
+
+#endif  // BYTE_CLASSES_HPP
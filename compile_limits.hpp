@@ -0,0 +1,39 @@
+#ifndef COMPILE_LIMITS_HPP
+#define COMPILE_LIMITS_HPP
+#include "std.hpp"
+
+// Upper bounds on what compiling one pattern may cost. They are checked
+// against NfaBuilder::estimate(), a single pass over the parsed pattern, so a
+// pattern like ((a{100}){100}){100} is turned down in time proportional to
+// its length, before any automaton is allocated. A RegexSet holds each of
+// its patterns and their sum to the same limits.
+struct CompileLimits {
+    size_t max_states = 1 << 18;                // NFA states of the program
+    size_t max_memory = 16 * 1024 * 1024;       // bytes of the programs (forward and reverse)
+    size_t max_depth = 256;                     // nesting of groups and repetitions
+    size_t max_dfa_cache = 8 * 1024 * 1024;     // bytes of each lazy DFA cache
+};
+
+// Thrown when a pattern needs more than its CompileLimits allow. A
+// std::runtime_error like every other compile failure, so callers that do not
+// care which limit was hit need not change.
+class CompileError : public std::runtime_error
+{
+public:
+    enum class Kind { STATES, MEMORY, DEPTH, DFA_CACHE };
+
+    CompileError(Kind k, size_t n, size_t l) : std::runtime_error(message(k, n, l)), kind(k), needed(n), limit(l) {}
+
+    Kind kind;
+    size_t needed;  // what the pattern would take
+    size_t limit;   // what it was allowed
+
+private:
+    static std::string message(Kind k, size_t n, size_t l){
+        static const char *const units[] = {"NFA states", "bytes of program", "levels of nesting", "bytes of DFA cache"};
+        return "pattern is too large: needs " + std::to_string(n) + " " + units[static_cast<int>(k)] +
+               ", the limit is " + std::to_string(l);
+    }
+};
+
+#endif  // COMPILE_LIMITS_HPP
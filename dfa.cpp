@@ -0,0 +1,497 @@
+#include "dfa.hpp"
+#include "nfa_builder.hpp"
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Layout of a serialized DFA:
+// [DfaHeader][uint8_t classes[256]][uint32_t table[num_states * num_classes]]
+// [uint8_t flags[num_states]]
+struct DfaHeader {
+    char magic[8];          // "RXDFA" + format version
+    uint32_t byte_order;    // BYTE_ORDER_MARK as written by the producing machine
+    uint32_t num_states;
+    uint32_t start;
+    uint16_t num_classes;
+    uint8_t anchored;
+    uint8_t empty_match;
+    uint8_t reserved[8];
+};
+static_assert(sizeof(DfaHeader) == 32, "DfaHeader must stay 32 bytes");
+
+const char DFA_MAGIC[8] = {'R', 'X', 'D', 'F', 'A', '\0', '\0', '\2'};
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Subset construction helpers: a DFA state is kept as a sorted vector of
+// NFA state indices
+struct Subsets {
+    const Program &prog;
+    std::vector<uint32_t> visited;
+    uint32_t stamp = 0;
+    std::vector<StateId> stack;
+
+    explicit Subsets(const Program &p) : prog(p), visited(p.size(), 0) {}
+
+    // Starts a new set: states visited before no longer count
+    void reset(){
+        if (++stamp == 0){
+            std::fill(visited.begin(), visited.end(), 0);
+            stamp = 1;
+        }
+    }
+
+    // Adds every consuming, MATCH or pending '$' state reachable from 's'
+    // through epsilon transitions to 'set'
+    void closure(std::vector<uint32_t> &set, StateId s, bool at_start, bool at_end){
+        stack.push_back(s);
+        while (!stack.empty()){
+            StateId id = stack.back();
+            stack.pop_back();
+            if (id == NO_STATE || visited[id] == stamp) continue;
+            visited[id] = stamp;
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+                stack.push_back(curr.out1);
+                stack.push_back(curr.out);
+                break;
+            case StateType::SAVE:
+                stack.push_back(curr.out);
+                break;
+            case StateType::ANCHOR_START:
+                if (at_start) stack.push_back(curr.out);
+                break;
+            case StateType::ANCHOR_END:
+                if (at_end) stack.push_back(curr.out);
+                else set.push_back(id);
+                break;
+            default:    // CHAR, DOT, CHAR_CLASS, MATCH
+                set.push_back(id);
+                break;
+            }
+        }
+    }
+
+    bool has_match(const std::vector<uint32_t> &set) const{
+        for (uint32_t idx : set){
+            if (prog[idx].type == StateType::MATCH) return true;
+        }
+        return false;
+    }
+};
+
+struct SetHash {
+    size_t operator()(const std::vector<uint32_t> &k) const{
+        size_t h = 14695981039346656037ULL;
+        for (uint32_t v : k){
+            h ^= v;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+}  // namespace
+
+// Determinizes the NFA with a breadth-first subset construction, then
+// minimizes the result. In search mode a thread is restarted at every
+// position and states containing MATCH become absorbing. Bytes of the same
+// class behave identically, so only one representative per class is tried.
+Dfa Dfa::compile(const Program &prog, bool anchored, size_t max_states){
+    if (!prog.counters.empty()) return compile(NfaBuilder::expand(prog), anchored, max_states);
+    Subsets sub(prog);
+    StateId nfa_start = prog.start;
+    Dfa dfa;
+    dfa.anchored = anchored;
+    dfa.classes = prog.byte_classes.map;
+    dfa.stride = prog.byte_classes.count;
+    const size_t stride = dfa.stride;
+    const std::vector<unsigned char> reps = prog.byte_classes.representatives();
+
+    std::unordered_map<std::vector<uint32_t>, uint32_t, SetHash> ids;
+    std::vector<std::vector<uint32_t>> sets;
+
+    // The dead state (empty set) is always state 0
+    sets.emplace_back();
+    dfa.owned_table.assign(stride, DEAD);
+    dfa.owned_flags.push_back(0);
+
+    auto intern = [&](std::vector<uint32_t> &set) -> uint32_t{
+        if (set.empty()) return DEAD;
+        std::sort(set.begin(), set.end());
+        auto it = ids.find(set);
+        if (it != ids.end()) return it->second;
+        if (sets.size() >= max_states) throw std::runtime_error("DFA exceeds the state limit");
+
+        uint32_t id = static_cast<uint32_t>(sets.size());
+        uint8_t f = 0;
+        if (!anchored && sub.has_match(set)) f |= MATCH;
+
+        // Matches at end of input: resolve pending '$' states (and, when
+        // searching, a thread started at the very end)
+        std::vector<uint32_t> eof;
+        sub.reset();
+        for (uint32_t idx : set) sub.closure(eof, idx, false, true);
+        if (!anchored) sub.closure(eof, nfa_start, false, true);
+        if (sub.has_match(eof)) f |= EOF_MATCH;
+
+        ids.emplace(set, id);
+        sets.push_back(set);
+        dfa.owned_table.resize(dfa.owned_table.size() + stride, DEAD);
+        dfa.owned_flags.push_back(f);
+        return id;
+    };
+
+    std::vector<uint32_t> set;
+    sub.reset();
+    sub.closure(set, nfa_start, true, false);
+    dfa.start = intern(set);
+
+    set.clear();
+    sub.reset();
+    sub.closure(set, nfa_start, true, true);
+    dfa.empty_match = sub.has_match(set);
+
+    // 'sets' grows while we walk it: every new state is expanded exactly once
+    for (size_t id = 1; id < sets.size(); id++){
+        if (dfa.owned_flags[id] & MATCH){
+            std::fill_n(dfa.owned_table.begin() + static_cast<std::ptrdiff_t>(id * stride), stride, static_cast<uint32_t>(id));
+            continue;
+        }
+        for (size_t k = 0; k < stride; k++){
+            char c = static_cast<char>(reps[k]);
+            std::vector<uint32_t> next;
+            sub.reset();
+            for (uint32_t idx : sets[id]){
+                const State &s = prog[idx];
+                if (prog.accepts(s, c)) sub.closure(next, s.out, false, false);
+            }
+            if (!anchored) sub.closure(next, nfa_start, false, false);
+            uint32_t to = intern(next);    // may grow the table, so index it afterwards
+            dfa.owned_table[id * stride + k] = to;
+        }
+    }
+
+    dfa.count = static_cast<uint32_t>(sets.size());
+    dfa.minimize();
+    return dfa;
+}
+
+// Hopcroft's partition refinement. States start out grouped by their flags;
+// a block is split whenever some of its states reach a splitter block on a
+// byte class and others do not. Equivalent states are then merged into one, with
+// the dead state kept as state 0.
+void Dfa::minimize(){
+    const uint32_t n = count;
+
+    // Inverse transitions per byte class, in CSR form: preds[b] lists, for
+    // every state t, the states s with table[s][b] == t
+    std::vector<std::vector<uint32_t>> pred_start(stride, std::vector<uint32_t>(n + 1, 0));
+    std::vector<std::vector<uint32_t>> preds(stride, std::vector<uint32_t>(n));
+    for (size_t b = 0; b < stride; b++){
+        std::vector<uint32_t> &off = pred_start[b];
+        for (uint32_t s = 0; s < n; s++) off[owned_table[s * stride + b] + 1]++;
+        for (uint32_t t = 0; t < n; t++) off[t + 1] += off[t];
+        std::vector<uint32_t> fill(off.begin(), off.end() - 1);
+        for (uint32_t s = 0; s < n; s++) preds[b][fill[owned_table[s * stride + b]]++] = s;
+    }
+
+    // Partition: the states of block k are elems[first[k] .. last[k])
+    std::vector<uint32_t> elems(n), loc(n), block_of(n);
+    std::vector<uint32_t> first, last, marked;
+    {
+        std::vector<uint32_t> order(n);
+        for (uint32_t s = 0; s < n; s++) order[s] = s;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+            return owned_flags[a] < owned_flags[b];
+        });
+        for (uint32_t i = 0; i < n; i++){
+            uint32_t s = order[i];
+            if (i == 0 || owned_flags[s] != owned_flags[order[i - 1]]){
+                first.push_back(i);
+                last.push_back(i);
+                marked.push_back(0);
+            }
+            elems[i] = s;
+            loc[s] = i;
+            block_of[s] = static_cast<uint32_t>(first.size() - 1);
+            last.back() = i + 1;
+        }
+    }
+
+    // Worklist of splitter blocks: every initial block but the largest
+    std::vector<uint32_t> work;
+    std::vector<bool> in_work(first.size(), false);
+    {
+        size_t largest = 0;
+        for (size_t k = 1; k < first.size(); k++){
+            if (last[k] - first[k] > last[largest] - first[largest]) largest = k;
+        }
+        for (size_t k = 0; k < first.size(); k++){
+            if (k == largest) continue;
+            work.push_back(static_cast<uint32_t>(k));
+            in_work[k] = true;
+        }
+    }
+
+    std::vector<uint32_t> splitter, touched;
+    while (!work.empty()){
+        uint32_t a = work.back();
+        work.pop_back();
+        in_work[a] = false;
+        splitter.assign(elems.begin() + first[a], elems.begin() + last[a]);
+
+        for (size_t b = 0; b < stride; b++){
+            touched.clear();
+            // Move every predecessor to the front of its block
+            for (uint32_t t : splitter){
+                for (uint32_t k = pred_start[b][t]; k < pred_start[b][t + 1]; k++){
+                    uint32_t s = preds[b][k];
+                    uint32_t blk = block_of[s];
+                    uint32_t pos = loc[s];
+                    uint32_t dest = first[blk] + marked[blk];
+                    if (pos < dest) continue;   // already marked
+                    std::swap(elems[pos], elems[dest]);
+                    loc[elems[pos]] = pos;
+                    loc[elems[dest]] = dest;
+                    if (marked[blk]++ == 0) touched.push_back(blk);
+                }
+            }
+            // Split the blocks that are only partially marked
+            for (uint32_t blk : touched){
+                uint32_t m = marked[blk];
+                marked[blk] = 0;
+                if (m == last[blk] - first[blk]) continue;
+
+                uint32_t nb = static_cast<uint32_t>(first.size());
+                first.push_back(first[blk]);
+                last.push_back(first[blk] + m);
+                marked.push_back(0);
+                first[blk] += m;
+                for (uint32_t i = first[nb]; i < last[nb]; i++) block_of[elems[i]] = nb;
+
+                if (in_work[blk]){
+                    in_work.push_back(true);
+                    work.push_back(nb);
+                }else{
+                    uint32_t smaller = (m <= last[blk] - first[blk]) ? nb : blk;
+                    in_work.push_back(false);
+                    in_work[smaller] = true;
+                    work.push_back(smaller);
+                }
+            }
+        }
+    }
+
+    // Renumber blocks: the dead state's block becomes 0, the rest in order of
+    // first appearance
+    size_t nblocks = first.size();
+    std::vector<uint32_t> new_id(nblocks, std::numeric_limits<uint32_t>::max());
+    uint32_t next_id = 0;
+    new_id[block_of[DEAD]] = next_id++;
+    for (uint32_t s = 0; s < n; s++){
+        if (new_id[block_of[s]] == std::numeric_limits<uint32_t>::max()) new_id[block_of[s]] = next_id++;
+    }
+
+    std::vector<uint32_t> table_min(static_cast<size_t>(next_id) * stride);
+    std::vector<uint8_t> flags_min(next_id);
+    for (uint32_t s = 0; s < n; s++){
+        uint32_t id = new_id[block_of[s]];
+        flags_min[id] = owned_flags[s];
+        for (size_t b = 0; b < stride; b++){
+            table_min[id * stride + b] = new_id[block_of[owned_table[s * stride + b]]];
+        }
+    }
+
+    start = new_id[block_of[start]];
+    count = next_id;
+    owned_table = std::move(table_min);
+    owned_flags = std::move(flags_min);
+    table = owned_table.data();
+    flags = owned_flags.data();
+}
+
+bool Dfa::is_match(std::string_view input) const{
+    if (input.empty()) return empty_match;
+    uint32_t s = start;
+    if (flags[s] & MATCH) return true;
+    for (char c : input){
+        s = table[static_cast<size_t>(s) * stride + classes[static_cast<unsigned char>(c)]];
+        if (flags[s] & MATCH) return true;
+        if (s == DEAD) return false;
+    }
+    return flags[s] & EOF_MATCH;
+}
+
+std::vector<char> Dfa::serialize() const{
+    DfaHeader h{};
+    std::memcpy(h.magic, DFA_MAGIC, sizeof(h.magic));
+    h.byte_order = BYTE_ORDER_MARK;
+    h.num_states = count;
+    h.start = start;
+    h.num_classes = static_cast<uint16_t>(stride);
+    h.anchored = anchored;
+    h.empty_match = empty_match;
+
+    size_t table_bytes = static_cast<size_t>(count) * stride * sizeof(uint32_t);
+    std::vector<char> out(sizeof(h) + classes.size() + table_bytes + count);
+    char *p = out.data();
+    std::memcpy(p, &h, sizeof(h));
+    p += sizeof(h);
+    std::memcpy(p, classes.data(), classes.size());
+    p += classes.size();
+    std::memcpy(p, table, table_bytes);
+    p += table_bytes;
+    std::memcpy(p, flags, count);
+    return out;
+}
+
+void Dfa::save(const std::string &path) const{
+    std::vector<char> bytes = serialize();
+    std::ofstream out(path, std::ios::binary);
+    if (!out) throw std::runtime_error("cannot open " + path + " for writing");
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!out) throw std::runtime_error("failed to write " + path);
+}
+
+// Validates a serialized DFA and points the tables into it
+Dfa Dfa::view(const void *data, size_t size){
+    DfaHeader h;
+    if (size < sizeof(h)) throw std::runtime_error("serialized DFA is truncated");
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, DFA_MAGIC, sizeof(h.magic)) != 0) throw std::runtime_error("not a serialized DFA");
+    if (h.byte_order != BYTE_ORDER_MARK) throw std::runtime_error("serialized DFA has the wrong byte order");
+
+    Dfa dfa;
+    const size_t map_bytes = dfa.classes.size();
+    size_t table_bytes = static_cast<size_t>(h.num_states) * h.num_classes * sizeof(uint32_t);
+    if (h.num_states == 0 || h.num_classes == 0 || h.num_classes > 256 || h.start >= h.num_states
+        || size != sizeof(h) + map_bytes + table_bytes + h.num_states){
+        throw std::runtime_error("serialized DFA is corrupt");
+    }
+
+    const char *bytes = static_cast<const char *>(data);
+    std::memcpy(dfa.classes.data(), bytes + sizeof(h), map_bytes);
+    dfa.table = reinterpret_cast<const uint32_t *>(bytes + sizeof(h) + map_bytes);
+    dfa.flags = reinterpret_cast<const uint8_t *>(bytes + sizeof(h) + map_bytes + table_bytes);
+    dfa.count = h.num_states;
+    dfa.start = h.start;
+    dfa.stride = h.num_classes;
+    dfa.anchored = h.anchored;
+    dfa.empty_match = h.empty_match;
+
+    // Classes and transitions are used as indices without further checks
+    for (uint8_t k : dfa.classes){
+        if (k >= dfa.stride) throw std::runtime_error("serialized DFA is corrupt");
+    }
+    for (size_t i = 0; i < static_cast<size_t>(dfa.count) * dfa.stride; i++){
+        if (dfa.table[i] >= dfa.count) throw std::runtime_error("serialized DFA is corrupt");
+    }
+    return dfa;
+}
+
+Dfa Dfa::load(const std::string &path){
+#ifdef _WIN32
+    // No mmap: read the file into memory owned by the DFA
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    Dfa loaded = view(bytes.data(), bytes.size());
+    Dfa dfa;
+    dfa.owned_table.assign(loaded.table, loaded.table + static_cast<size_t>(loaded.count) * loaded.stride);
+    dfa.owned_flags.assign(loaded.flags, loaded.flags + loaded.count);
+    dfa.table = dfa.owned_table.data();
+    dfa.flags = dfa.owned_flags.data();
+    dfa.count = loaded.count;
+    dfa.start = loaded.start;
+    dfa.stride = loaded.stride;
+    dfa.classes = loaded.classes;
+    dfa.anchored = loaded.anchored;
+    dfa.empty_match = loaded.empty_match;
+    return dfa;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0){
+        ::close(fd);
+        throw std::runtime_error("cannot read " + path);
+    }
+    size_t len = static_cast<size_t>(st.st_size);
+    void *addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+
+    try{
+        Dfa dfa = view(addr, len);
+        dfa.map_addr = addr;
+        dfa.map_len = len;
+        return dfa;
+    }catch (...){
+        ::munmap(addr, len);
+        throw;
+    }
+#endif
+}
+
+void Dfa::unmap(){
+#ifndef _WIN32
+    if (map_addr) ::munmap(map_addr, map_len);
+#endif
+    map_addr = nullptr;
+    map_len = 0;
+}
+
+Dfa::Dfa(Dfa &&other) noexcept{
+    *this = std::move(other);
+}
+
+// Moving the owned vectors keeps their buffers, so 'table' and 'flags' stay valid
+Dfa &Dfa::operator=(Dfa &&other) noexcept{
+    if (this == &other) return *this;
+    unmap();
+    table = other.table;
+    flags = other.flags;
+    count = other.count;
+    start = other.start;
+    stride = other.stride;
+    classes = other.classes;
+    anchored = other.anchored;
+    empty_match = other.empty_match;
+    owned_table = std::move(other.owned_table);
+    owned_flags = std::move(other.owned_flags);
+    map_addr = other.map_addr;
+    map_len = other.map_len;
+    other.map_addr = nullptr;
+    other.map_len = 0;
+    other.table = nullptr;
+    other.flags = nullptr;
+    other.count = 0;
+    return *this;
+}
+
+Dfa::~Dfa(){
+    unmap();
+}
+
+// Time Complexity Analysis:
+
+// m = number of NFA states, d = number of DFA states before minimization,
+// k = number of byte classes (at most 256, usually a handful)
+
+// compile():
+// Each DFA state computes k closures of O(m) → O(d * k * m), plus hashing
+// the sets. d can be exponential in m in the worst case, which is what
+// 'max_states' guards against.
+
+// minimize():
+// Hopcroft's algorithm → O(k * d log d)
+
+// is_match():
+// One table lookup per input byte → O(n)
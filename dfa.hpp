@@ -0,0 +1,77 @@
+#ifndef DFA_HPP
+#define DFA_HPP
+#include "nfa.hpp"
+
+// Full DFA compiled ahead of time.
+// The NFA is determinized eagerly, minimized with Hopcroft's algorithm and
+// stored as a dense table with one transition per byte class (see
+// ByteClasses) per state. The table can be
+// written to a flat binary file and memory-mapped back at startup, skipping
+// Parser -> NfaBuilder entirely and letting processes
+// that map the same file share its pages.
+//
+// A DFA answers a single question, chosen at compile time:
+// anchored = false: does some substring of the input match?
+// anchored = true:  does the whole input match?
+class Dfa
+{
+public:
+    static constexpr size_t DEFAULT_MAX_STATES = 10000;
+
+    // Determinizes and minimizes the NFA program, expanded first if it has
+    // counted loops (see NfaBuilder::expand).
+    // Throws std::runtime_error if the DFA needs more than 'max_states' states.
+    static Dfa compile(const Program &prog, bool anchored, size_t max_states = DEFAULT_MAX_STATES);
+
+    // Serialized form: a fixed header followed by the byte class map, the
+    // transition table and the per-state flags, in native byte order
+    std::vector<char> serialize() const;
+    void save(const std::string &path) const;
+
+    // Maps a file written by save() read-only (no copy of the table is made)
+    static Dfa load(const std::string &path);
+    // Uses an in-memory serialized DFA; 'data' must outlive the returned object
+    static Dfa view(const void *data, size_t size);
+
+    bool is_match(std::string_view input) const;
+
+    size_t num_states() const { return count; }
+    size_t num_classes() const { return stride; }
+    bool is_anchored() const { return anchored; }
+
+    Dfa(Dfa &&other) noexcept;
+    Dfa &operator=(Dfa &&other) noexcept;
+    Dfa(const Dfa &) = delete;
+    Dfa &operator=(const Dfa &) = delete;
+    ~Dfa();
+
+private:
+    Dfa() = default;
+
+    // Per-state flags
+    static constexpr uint8_t MATCH = 1;     // a match has been seen (search mode only, absorbing)
+    static constexpr uint8_t EOF_MATCH = 2; // matches if the input ends here
+
+    static constexpr uint32_t DEAD = 0;
+
+    void minimize();
+    void unmap();
+
+    // Either point into 'owned_*' or into a mapped/borrowed buffer
+    const uint32_t *table = nullptr;
+    const uint8_t *flags = nullptr;
+    uint32_t count = 0;
+    uint32_t start = 0;
+    uint32_t stride = 256;      // transitions per state: number of byte classes
+    std::array<uint8_t, 256> classes{};
+    bool anchored = false;
+    bool empty_match = false;   // result for the empty input
+
+    std::vector<uint32_t> owned_table;
+    std::vector<uint8_t> owned_flags;
+
+    void *map_addr = nullptr;
+    size_t map_len = 0;
+};
+
+#endif  // DFA_HPP
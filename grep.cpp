@@ -0,0 +1,181 @@
+#include "grep.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Grep::Grep(std::string_view pattern, GrepOptions o) : regex(pattern, RegexOptions{.shared_dfa = o.shared_dfa, .captures = false}), options(o){
+    if (options.threads == 0) options.threads = std::max(1u, std::thread::hardware_concurrency());
+    if (options.chunk_size == 0) options.chunk_size = 1;
+}
+
+static size_t count_newlines(std::string_view s){
+    return static_cast<size_t>(std::count(s.begin(), s.end(), '\n'));
+}
+
+// Candidate lines are the ones holding a position where a match can start
+// (the prefilter's prefix or first bytes), or else the required literal, or
+// else the required suffix; without any of those every line is a candidate.
+void Grep::scan_chunk(Regex::Cache &cache, Chunk &chunk) const{
+    const std::string_view text = chunk.text;
+    const Prefilter &pre = regex.program().prefilter;
+    auto next_candidate = [&](size_t from){
+        if (pre.is_active()) return pre.find(text, from);
+        if (!pre.required().empty()) return text.find(pre.required(), from);
+        if (!pre.required_suffix().empty()) return pre.find_suffix(text, from);
+        return from < text.size() ? from : std::string_view::npos;
+    };
+
+    size_t line_start = 0, line_number = 0;
+    while (line_start < text.size()){
+        size_t at = next_candidate(line_start);
+        if (at == std::string_view::npos) break;
+
+        // Move to the line holding 'at'
+        if (at > line_start){
+            size_t nl = text.rfind('\n', at - 1);
+            if (nl != std::string_view::npos && nl >= line_start){
+                if (options.line_numbers) line_number += count_newlines(text.substr(line_start, nl + 1 - line_start));
+                line_start = nl + 1;
+            }
+        }
+        const void *hit = std::memchr(text.data() + at, '\n', text.size() - at);
+        size_t line_end = hit ? static_cast<size_t>(static_cast<const char *>(hit) - text.data()) : text.size();
+
+        std::string_view line = text.substr(line_start, line_end - line_start);
+        if (regex.is_match(line, cache)) chunk.lines.emplace_back(line_number, line);
+        line_start = line_end + 1;
+        line_number++;
+    }
+    if (options.line_numbers) chunk.newlines = count_newlines(text);
+}
+
+// Workers take chunks in order from a shared counter and may run at most
+// 'window' chunks ahead of the writer, which keeps the pending results (views
+// into 'data', not copies) bounded however large the input is.
+size_t Grep::scan(std::string_view data, std::ostream &out, std::string_view label){
+    std::vector<Chunk> chunks;
+    for (size_t begin = 0; begin < data.size();){
+        size_t end = std::min(data.size(), begin + options.chunk_size);
+        if (end < data.size()){
+            const void *hit = std::memchr(data.data() + end, '\n', data.size() - end);
+            end = hit ? static_cast<size_t>(static_cast<const char *>(hit) - data.data()) + 1 : data.size();
+        }
+        chunks.push_back(Chunk{data.substr(begin, end - begin), {}, 0, false});
+        begin = end;
+    }
+
+    const size_t num_threads = std::min(options.threads, std::max<size_t>(chunks.size(), 1));
+    const size_t window = 4 * num_threads;
+    std::mutex mutex;
+    std::condition_variable ready_cv, written_cv;
+    std::atomic<size_t> next_chunk{0};
+    size_t written = 0;     // guarded by 'mutex'
+    std::exception_ptr failure;
+
+    auto work = [&](){
+        try{
+            Regex::Cache cache(regex);
+            for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++){
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    written_cv.wait(lock, [&]{ return i < written + window || failure; });
+                    if (failure) return;
+                }
+                scan_chunk(cache, chunks[i]);
+                std::lock_guard<std::mutex> lock(mutex);
+                chunks[i].ready = true;
+                ready_cv.notify_all();
+            }
+        }catch (...){
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) failure = std::current_exception();
+            ready_cv.notify_all();
+            written_cv.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; t++) workers.emplace_back(work);
+
+    size_t matched = 0, line_base = 1;
+    for (size_t i = 0; i < chunks.size(); i++){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready_cv.wait(lock, [&]{ return chunks[i].ready || failure; });
+            if (failure) break;
+        }
+        Chunk &chunk = chunks[i];
+        matched += chunk.lines.size();
+        if (!options.count_only){
+            for (const auto &[number, line] : chunk.lines){
+                if (!label.empty()) out << label << ':';
+                if (options.line_numbers) out << line_base + number << ':';
+                out << line << '\n';
+            }
+        }
+        line_base += chunk.newlines;
+        chunk.lines = {};
+        std::lock_guard<std::mutex> lock(mutex);
+        written = i + 1;
+        written_cv.notify_all();
+    }
+    for (std::thread &w : workers) w.join();
+    if (failure) std::rethrow_exception(failure);
+
+    if (options.count_only){
+        if (!label.empty()) out << label << ':';
+        out << matched << '\n';
+    }
+    return matched;
+}
+
+MappedFile::MappedFile(const std::string &path){
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    owned.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    addr = owned.data();
+    len = owned.size();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0){
+        ::close(fd);
+        throw std::runtime_error("cannot read " + path);
+    }
+    len = static_cast<size_t>(st.st_size);
+    if (len == 0){
+        ::close(fd);
+        return;
+    }
+    void *p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+    ::madvise(p, len, MADV_SEQUENTIAL);
+    addr = static_cast<const char *>(p);
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifndef _WIN32
+    if (len > 0) ::munmap(const_cast<char *>(addr), len);
+#endif
+}
+
+// Time Complexity Analysis:
+
+// n = input length, L = number of candidate lines, l = average line length,
+// p = number of threads
+
+// scan():
+// The prefilter passes over every chunk once (O(n)) and every candidate line
+// costs one Regex::is_match (O(l) with warm caches) → O(n + L * l) work,
+// split over p threads; writing the output is sequential
@@ -0,0 +1,64 @@
+#ifndef GREP_HPP
+#define GREP_HPP
+#include "regex.hpp"
+
+struct GrepOptions {
+    size_t threads = 0;                 // 0 = one per hardware thread
+    size_t chunk_size = 4 * 1024 * 1024;
+    bool line_numbers = false;          // prefix every line with its number
+    bool count_only = false;            // print the number of matching lines only
+    bool shared_dfa = true;             // workers share one lazy DFA cache (RegexOptions::shared_dfa)
+};
+
+// Line-oriented search over a large buffer, regex-grep style.
+// The buffer is split into newline-aligned chunks that worker threads scan
+// independently (sharing one compiled pattern, each with its own
+// Regex::Cache); the matching lines are written in their original order.
+// Within a chunk, the pattern's prefilter jumps straight to candidate lines
+// and every candidate line is checked with Regex::is_match, so '^' and '$'
+// hold at the start and end of each line.
+class Grep
+{
+public:
+    // Throws std::runtime_error if the pattern does not compile
+    explicit Grep(std::string_view pattern, GrepOptions options = {});
+
+    // Writes every line of 'data' that contains a match to 'out' (preceded by
+    // 'label' when it is not empty), or their count with count_only.
+    // Returns the number of matching lines.
+    size_t scan(std::string_view data, std::ostream &out, std::string_view label = "");
+
+private:
+    struct Chunk {
+        std::string_view text;
+        std::vector<std::pair<size_t, std::string_view>> lines;  // line number within the chunk, line
+        size_t newlines = 0;
+        bool ready = false;
+    };
+
+    void scan_chunk(Regex::Cache &cache, Chunk &chunk) const;
+
+    Regex regex;
+    GrepOptions options;
+};
+
+// A whole file mapped read-only (read into memory where mmap is not available)
+class MappedFile
+{
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    std::string_view data() const { return {addr, len}; }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+private:
+    const char *addr = nullptr;
+    size_t len = 0;
+    std::vector<char> owned;
+};
+
+#endif  // GREP_HPP
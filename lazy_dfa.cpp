@@ -0,0 +1,625 @@
+#include "lazy_dfa.hpp"
+
+// Approximate bytes held by one cached state with a list of 'len' entries:
+// its transition row, the key stored in the map and the bookkeeping around it
+size_t LazyDfa::state_cost(size_t len) const{
+    return stride * sizeof(int) + sizeof(uint32_t) * len + 64;
+}
+
+size_t LazyDfa::KeyHash::operator()(const Key &k) const{
+    // FNV-1a over the list entries
+    size_t h = 14695981039346656037ULL;
+    for (uint32_t v : k){
+        h ^= v;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+LazyDfa::LazyDfa(const Program &p, size_t cache_budget)
+    : prog(p), classes(p.byte_classes), stride(p.byte_classes.count), budget(cache_budget), fallback(p){
+    visited.assign(prog.size(), 0);
+    stack.reserve(prog.size());
+    for (const State &s : prog.states){
+        if (s.type == StateType::MATCH) num_patterns = std::max(num_patterns, static_cast<size_t>(s.pattern) + 1);
+    }
+    flush();
+    flushes = 0;
+}
+
+// Drops every cached state; only the dead state survives
+void LazyDfa::flush(){
+    static const Key dead_key{MODE_FULL};
+    cache.clear();
+    states.clear();
+    trans.clear();
+    states.push_back({&dead_key, false, 0});
+    trans.assign(stride, DEAD);
+    set_info.assign(1, SetInfo{});
+    set_info[0].eof_computed = true;
+    pattern_ids.clear();
+    std::fill(std::begin(start_ids), std::end(start_ids), UNKNOWN);
+    memory_used = state_cost(0);
+    flushes++;
+}
+
+void LazyDfa::next_stamp(){
+    if (++stamp == 0){
+        std::fill(visited.begin(), visited.end(), 0);
+        stamp = 1;
+    }
+}
+
+// Appends to 'list' every consuming, MATCH or pending '$' state reachable from
+// 's' through epsilon transitions, in priority order ('out' before 'out1').
+// States already visited under the current stamp are skipped.
+void LazyDfa::closure(Key &list, StateId s, bool at_start, bool at_end){
+    stack.push_back(s);
+    while (!stack.empty()){
+        StateId id = stack.back();
+        stack.pop_back();
+        while (id != NO_STATE && visited[id] != stamp){
+            visited[id] = stamp;
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+                if (curr.out1 != NO_STATE) stack.push_back(curr.out1);
+                id = curr.out;
+                break;
+            case StateType::SAVE:
+                id = curr.out;
+                break;
+            case StateType::ANCHOR_START:
+                id = at_start ? curr.out : NO_STATE;
+                break;
+            case StateType::ANCHOR_END:
+                if (at_end){
+                    id = curr.out;
+                }else{
+                    list.push_back(id);     // decided once we know whether input ends here
+                    id = NO_STATE;
+                }
+                break;
+            default:    // CHAR, DOT, CHAR_CLASS, MATCH
+                list.push_back(id);
+                id = NO_STATE;
+                break;
+            }
+        }
+    }
+}
+
+// Returns the id of the state with the given key, creating it if needed.
+// Lists without any entry all map to the dead state.
+int LazyDfa::add_state(Key key){
+    if (key.size() == 1) return DEAD;
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second;
+
+    bool has_match = false;
+    SetInfo info;
+    info.first = static_cast<uint32_t>(pattern_ids.size());
+    for (size_t k = 1; k < key.size(); k++){
+        if (key[k] != RESTART && prog[key[k]].type == StateType::MATCH){
+            has_match = true;
+            if (key[0] != MODE_SET) break;
+            pattern_ids.push_back(prog[key[k]].pattern);
+        }
+    }
+    info.count = static_cast<uint32_t>(pattern_ids.size()) - info.first;
+    memory_used += state_cost(key.size());
+    int id = static_cast<int>(states.size());
+    if (start_ids[MODE_SEARCH] == UNKNOWN && key == search_start_key) start_ids[MODE_SEARCH] = id;
+    auto inserted = cache.emplace(std::move(key), id).first;
+    states.push_back({&inserted->first, has_match, -1});
+    set_info.push_back(info);
+    trans.resize(trans.size() + stride, UNKNOWN);
+    return id;
+}
+
+int LazyDfa::start_state(uint32_t mode){
+    if (start_ids[mode] != UNKNOWN) return start_ids[mode];
+    if (memory_used > budget) flush();
+
+    Key key{mode == MODE_FULL_MID ? MODE_FULL : mode};
+    next_stamp();
+    closure(key, prog.start, mode != MODE_FULL_MID, false);
+    if (mode == MODE_SEARCH || mode == MODE_SET) key.push_back(RESTART);
+    if (mode == MODE_SEARCH) search_start_key = key;
+    start_ids[mode] = add_state(std::move(key));
+    return start_ids[mode];
+}
+
+// Computes and memoizes the transition of state 'from' on 'byte' (and so on
+// every byte of its class).
+// 'pos' is the input position, used to detect a thrashing cache.
+int LazyDfa::transition(int from, unsigned char byte, size_t pos){
+    const Key &curr = *states[from].key;
+    uint32_t mode = curr[0];
+    char c = static_cast<char>(byte);
+
+    Key next{mode};
+    next_stamp();
+    for (size_t k = 1; k < curr.size(); k++){
+        if (curr[k] == RESTART){
+            // Lowest priority: a thread starting right after this byte
+            closure(next, prog.start, false, false);
+            next.push_back(RESTART);
+            continue;
+        }
+        const State &s = prog[curr[k]];
+        if (s.type == StateType::MATCH){
+            // In a leftmost-first search, threads after a match are cut
+            if (mode == MODE_SEARCH) break;
+            continue;
+        }
+        if (prog.accepts(s, c)) closure(next, s.out, false, false);
+    }
+    if (mode == MODE_SEARCH){
+        for (size_t k = 1; k < next.size(); k++){
+            if (next[k] != RESTART && prog[next[k]].type == StateType::MATCH){
+                next.resize(k + 1);
+                break;
+            }
+        }
+    }
+
+    if (memory_used + state_cost(next.size()) > budget && !cache.count(next)){
+        // Give up if the cache keeps filling up after only a few bytes
+        size_t created = states.size();
+        if (may_give_up && ++search_flushes >= 3 && pos - last_flush_pos < 10 * created) return GAVE_UP;
+        last_flush_pos = pos;
+
+        Key saved = curr;
+        flush();
+        from = add_state(std::move(saved));
+    }
+    int to = add_state(std::move(next));
+    trans[static_cast<size_t>(from) * stride + classes[byte]] = to;
+    return to;
+}
+
+// Whether state 'id' matches when the input ends right after it, which
+// resolves the pending '$' states on its list
+bool LazyDfa::eof_match(int id, bool at_start){
+    DState &d = states[id];
+    if (!at_start && d.eof_match >= 0) return d.eof_match;
+
+    const Key &key = *d.key;
+    Key list;
+    next_stamp();
+    for (size_t k = 1; k < key.size(); k++){
+        closure(list, key[k] == RESTART ? prog.start : key[k], at_start, true);
+    }
+    bool result = false;
+    for (uint32_t idx : list){
+        if (prog[idx].type == StateType::MATCH){
+            result = true;
+            break;
+        }
+    }
+    if (!at_start) d.eof_match = result;
+    return result;
+}
+
+// Input that lacks a required literal is rejected up front. While the DFA
+// sits in its start state (no thread alive, only the restart), the program's
+// prefilter skips to the next position where a match can start. A pattern
+// with an active prefilter cannot start with '^', so that state is the same
+// at every position; after a flush, the first transition back to its list
+// makes it the start state again (see add_state()).
+bool LazyDfa::is_match(std::string_view input){
+    if (!prog.prefilter.may_match(input)) return false;
+    may_give_up = true;
+    search_flushes = 0;
+    last_flush_pos = 0;
+    int s = start_state(MODE_SEARCH);
+    if (states[s].is_match) return true;
+    const Prefilter &pre = prog.prefilter;
+    bool skip = pre.is_active();
+
+    for (size_t i = 0; i < input.size(); i++){
+        if (skip && s == start_ids[MODE_SEARCH]){
+            i = pre.find(input, i);
+            if (i == std::string_view::npos) return false;
+        }
+        unsigned char b = static_cast<unsigned char>(input[i]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN){
+            next = transition(s, b, i);
+            if (next == GAVE_UP){
+                fallbacks++;
+                return fallback.search(input);
+            }
+        }
+        s = next;
+        if (states[s].is_match) return true;
+        if (s == DEAD) return false;
+    }
+    return eof_match(s, input.empty());
+}
+
+// The lanes never build states one at a time in isolation: a transition that
+// flushes the cache renumbers the states the other lanes are in, so every
+// unfinished input is then answered by is_match() on its own and the lanes
+// start over with the inputs after them. Each input is read at most twice.
+// If the cache thrashes, the rest of the batch goes through is_match(),
+// which has its own fallback.
+void LazyDfa::is_match_batch(std::span<const std::string_view> inputs, std::vector<bool> &matched){
+    struct Lane {
+        size_t input;
+        size_t pos;
+        int state;
+    };
+    matched.assign(inputs.size(), false);
+    const Prefilter &pre = prog.prefilter;
+    Lane lanes[BATCH_LANES];
+    size_t active = 0, next = 0;
+    size_t consumed = 0;    // bytes read by the lanes: the position for thrash detection
+    bool interleave = true;
+    int start = DEAD;
+
+    auto restart = [&](){
+        may_give_up = true;
+        search_flushes = 0;
+        last_flush_pos = consumed;
+        start = start_state(MODE_SEARCH);
+    };
+    // Puts the next input that is not answered up front into 'lane'
+    auto fill = [&](Lane &lane){
+        while (next < inputs.size()){
+            size_t i = next++;
+            if (!pre.may_match(inputs[i])) continue;
+            if (states[start].is_match){
+                matched[i] = true;
+                continue;
+            }
+            lane = Lane{i, 0, start};
+            return true;
+        }
+        return false;
+    };
+
+    // With every lane busy: rounds of one byte per lane, for as long as no
+    // lane reaches its end, needs a new state, dies or matches. The lookups
+    // of a round do not depend on each other. Lanes are spelled out so that
+    // their states stay in registers.
+    static_assert(BATCH_LANES == 4, "run_full_lanes() steps exactly four lanes");
+    auto run_full_lanes = [&](){
+        const unsigned char *text[BATCH_LANES], *text_end[BATCH_LANES];
+        int s[BATCH_LANES];
+        for (size_t k = 0; k < BATCH_LANES; k++){
+            std::string_view input = inputs[lanes[k].input];
+            text[k] = reinterpret_cast<const unsigned char *>(input.data()) + lanes[k].pos;
+            text_end[k] = reinterpret_cast<const unsigned char *>(input.data()) + input.size();
+            s[k] = lanes[k].state;
+        }
+        auto advance = [&](size_t k){
+            if (text[k] == text_end[k]) return false;
+            int to = trans[static_cast<size_t>(s[k]) * stride + classes[*text[k]]];
+            if (to <= DEAD || states[to].is_match) return false;
+            s[k] = to;
+            text[k]++;
+            return true;
+        };
+        while (advance(0) && advance(1) && advance(2) && advance(3)) {}
+        for (size_t k = 0; k < BATCH_LANES; k++){
+            std::string_view input = inputs[lanes[k].input];
+            size_t pos = static_cast<size_t>(text[k] - reinterpret_cast<const unsigned char *>(input.data()));
+            consumed += pos - lanes[k].pos;
+            lanes[k].pos = pos;
+            lanes[k].state = s[k];
+        }
+    };
+
+    restart();
+    while (true){
+        while (active < BATCH_LANES && fill(lanes[active])) active++;
+        bool stale = false;
+        while (active > 0 && !stale){
+            if (active == BATCH_LANES) run_full_lanes();
+            // One step of every lane, taking care of whatever stopped the rounds
+            for (size_t k = 0; k < active;){
+                Lane &lane = lanes[k];
+                std::string_view input = inputs[lane.input];
+                int result = -1;    // not known yet
+                if (lane.pos == input.size()){
+                    result = eof_match(lane.state, input.empty());
+                }else{
+                    unsigned char b = static_cast<unsigned char>(input[lane.pos]);
+                    int to = trans[static_cast<size_t>(lane.state) * stride + classes[b]];
+                    if (to == UNKNOWN){
+                        size_t before = flushes;
+                        to = transition(lane.state, b, consumed);
+                        if (to == GAVE_UP || flushes != before){
+                            interleave = to != GAVE_UP;
+                            stale = true;
+                            break;
+                        }
+                    }
+                    lane.pos++;
+                    consumed++;
+                    lane.state = to;
+                    if (states[to].is_match) result = 1;
+                    else if (to == DEAD) result = 0;
+                }
+                if (result < 0){
+                    k++;
+                }else{
+                    matched[lane.input] = result;
+                    if (fill(lane)) k++;
+                    else lane = lanes[--active];
+                }
+            }
+        }
+        if (!stale) break;
+
+        for (size_t k = 0; k < active; k++) matched[lanes[k].input] = is_match(inputs[lanes[k].input]);
+        active = 0;
+        if (!interleave){
+            for (; next < inputs.size(); next++) matched[next] = is_match(inputs[next]);
+            break;
+        }
+        restart();
+    }
+}
+
+// Same scan as is_match(), carried on past the first match: threads of a
+// lower priority than a match are cut, so once the state goes dead the last
+// match seen is the leftmost-first one.
+size_t LazyDfa::find_end(std::string_view input){
+    const size_t npos = std::string_view::npos;
+    if (!prog.prefilter.may_match(input)) return npos;
+    may_give_up = true;
+    search_flushes = 0;
+    last_flush_pos = 0;
+    int s = start_state(MODE_SEARCH);
+    size_t end = states[s].is_match ? 0 : npos;
+    const Prefilter &pre = prog.prefilter;
+    bool skip = pre.is_active();
+
+    for (size_t i = 0; i < input.size(); i++){
+        if (skip && s == start_ids[MODE_SEARCH]){
+            i = pre.find(input, i);
+            if (i == npos) return npos;
+        }
+        unsigned char b = static_cast<unsigned char>(input[i]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN){
+            next = transition(s, b, i);
+            if (next == GAVE_UP){
+                fallbacks++;
+                Captures caps;
+                return fallback.search(input, &caps) ? caps[1] : npos;
+            }
+        }
+        s = next;
+        if (s == DEAD) return end;
+        if (states[s].is_match) end = i + 1;
+    }
+    if (eof_match(s, input.empty())) end = input.size();
+    return end;
+}
+
+void LazyDfa::begin(Scan &scan){
+    scan = Scan{};
+    scan.state = start_state(MODE_SEARCH);
+    if (states[scan.state].is_match) scan.end = 0;
+}
+
+// Same loop as find_end(). The prefilter only sees one piece at a time, so a
+// literal prefix that starts near the end of a piece may end in the next one:
+// the last (prefix length - 1) bytes of every piece go through the DFA
+// instead of being skipped.
+void LazyDfa::feed(Scan &scan, std::string_view piece){
+    if (scan.settled){
+        scan.offset += piece.size();
+        return;
+    }
+    may_give_up = false;
+    const Prefilter &pre = prog.prefilter;
+    bool skip = pre.is_active();
+    size_t keep = pre.literal().size() > 1 ? pre.literal().size() - 1 : 0;
+    size_t tail = piece.size() - std::min(piece.size(), keep);
+
+    int s = scan.state;
+    for (size_t i = 0; i < piece.size(); i++){
+        if (skip && s == start_ids[MODE_SEARCH] && i < tail){
+            size_t next = pre.find(piece, i);
+            i = next == std::string_view::npos ? tail : next;
+            if (i == piece.size()) break;
+        }
+        unsigned char b = static_cast<unsigned char>(piece[i]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN) next = transition(s, b, scan.offset + i);
+        s = next;
+        if (s == DEAD){
+            scan.settled = true;
+            break;
+        }
+        if (states[s].is_match) scan.end = scan.offset + i + 1;
+    }
+    scan.state = s;
+    scan.offset += piece.size();
+}
+
+// Resolves the '$' states still pending at the end of the input
+void LazyDfa::finish(Scan &scan){
+    if (scan.settled) return;
+    if (eof_match(scan.state, scan.offset == 0)) scan.end = scan.offset;
+    scan.settled = true;
+}
+
+// Anchored at 'end' and never cutting a thread, so the scan reports every
+// position where a match can start and keeps the last (smallest) one.
+// '$' of the original pattern is '^' of the reversed one and holds only if
+// 'end' is the end of the input.
+size_t LazyDfa::find_start(std::string_view input, size_t end){
+    may_give_up = false;
+    search_flushes = 0;
+    last_flush_pos = 0;
+    int s = start_state(end == input.size() ? MODE_FULL : MODE_FULL_MID);
+    size_t start = states[s].is_match ? end : std::string_view::npos;
+
+    for (size_t i = end; i > 0; i--){
+        unsigned char b = static_cast<unsigned char>(input[i - 1]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN) next = transition(s, b, end - i);
+        s = next;
+        if (s == DEAD) return start;
+        if (states[s].is_match) start = i - 1;
+    }
+    if (eof_match(s, input.empty())) start = 0;
+    return start;
+}
+
+int LazyDfa::ends_at(std::string_view input, size_t end, size_t &limit){
+    may_give_up = false;
+    search_flushes = 0;
+    last_flush_pos = 0;
+    int s = start_state(end == input.size() ? MODE_FULL : MODE_FULL_MID);
+    if (states[s].is_match) return 1;
+
+    for (size_t i = end; i > 0; i--){
+        if (limit == 0) return -1;
+        limit--;
+        unsigned char b = static_cast<unsigned char>(input[i - 1]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN) next = transition(s, b, end - i);
+        s = next;
+        if (states[s].is_match) return 1;
+        if (s == DEAD) return 0;
+    }
+    return eof_match(s, input.empty()) ? 1 : 0;
+}
+
+// Collects into 'list' the MATCH states reachable once the input ends right
+// after state 'id'
+void LazyDfa::eof_patterns(Key &list, int id, bool at_start){
+    const Key &key = *states[id].key;
+    next_stamp();
+    for (size_t k = 1; k < key.size(); k++){
+        closure(list, key[k] == RESTART ? prog.start : key[k], at_start, true);
+    }
+    list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t idx){
+        return prog[idx].type != StateType::MATCH;
+    }), list.end());
+}
+
+// Adds the patterns pattern_ids[first .. first + count) not found yet
+void LazyDfa::report(uint32_t first, uint32_t count, std::vector<size_t> &patterns){
+    for (uint32_t k = first; k < first + count; k++){
+        uint32_t p = pattern_ids[k];
+        if (found[p]) continue;
+        found[p] = true;
+        patterns.push_back(p);
+    }
+}
+
+// Runs every pattern at once: threads are never cut after a match, and the
+// patterns of the MATCH states on each state's list are reported the first
+// time the search enters that state.
+void LazyDfa::which_match(std::string_view input, std::vector<size_t> &patterns){
+    patterns.clear();
+    found.assign(num_patterns, false);
+    if (++report_stamp == 0){
+        for (SetInfo &info : set_info) info.reported = 0;
+        report_stamp = 1;
+    }
+    may_give_up = false;
+    search_flushes = 0;
+    last_flush_pos = 0;
+
+    auto enter = [&](int id){
+        SetInfo &info = set_info[id];
+        if (info.reported == report_stamp) return;
+        info.reported = report_stamp;
+        report(info.first, info.count, patterns);
+    };
+
+    int s = start_state(MODE_SET);
+    if (states[s].is_match) enter(s);
+    for (size_t i = 0; i < input.size() && patterns.size() < num_patterns; i++){
+        unsigned char b = static_cast<unsigned char>(input[i]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN) next = transition(s, b, i);
+        s = next;
+        if (states[s].is_match) enter(s);
+        if (s == DEAD) break;
+    }
+
+    if (patterns.size() < num_patterns){
+        // Patterns that match at the very end ('$')
+        bool at_start = input.empty();
+        SetInfo &info = set_info[s];
+        if (at_start || !info.eof_computed){
+            Key list;
+            eof_patterns(list, s, at_start);
+            if (at_start){
+                for (uint32_t idx : list){
+                    uint32_t p = prog[idx].pattern;
+                    if (!found[p]){
+                        found[p] = true;
+                        patterns.push_back(p);
+                    }
+                }
+            }else{
+                info.eof_first = static_cast<uint32_t>(pattern_ids.size());
+                for (uint32_t idx : list) pattern_ids.push_back(prog[idx].pattern);
+                info.eof_count = static_cast<uint32_t>(list.size());
+                info.eof_computed = true;
+            }
+        }
+        if (!at_start) report(info.eof_first, info.eof_count, patterns);
+    }
+    std::sort(patterns.begin(), patterns.end());
+}
+
+bool LazyDfa::full_match(std::string_view input){
+    if (!prog.prefilter.may_match(input)) return false;
+    may_give_up = true;
+    search_flushes = 0;
+    last_flush_pos = 0;
+    int s = start_state(MODE_FULL);
+
+    for (size_t i = 0; i < input.size(); i++){
+        unsigned char b = static_cast<unsigned char>(input[i]);
+        int next = trans[static_cast<size_t>(s) * stride + classes[b]];
+        if (next == UNKNOWN){
+            next = transition(s, b, i);
+            if (next == GAVE_UP){
+                fallbacks++;
+                return fallback.match(input);
+            }
+        }
+        s = next;
+        if (s == DEAD) return false;
+    }
+    return eof_match(s, input.empty());
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states
+
+// transition():
+// One step of the subset construction: O(m) (each NFA state is visited once
+// per closure thanks to the stamps), plus hashing the new list
+
+// which_match():
+// Same as is_match(), plus O(p) to report the p matching patterns
+
+// is_match_batch():
+// Same as is_match() over every input; an input is read at most twice (once
+// more after a flush)
+
+// feed():
+// Same as is_match() over the piece
+
+// find_end() / find_start() / ends_at():
+// Same as is_match(); find_start() and ends_at() only read input[0, end)
+
+// is_match() / full_match():
+// O(1) per byte once the needed transitions are cached, O(m) for a byte that
+// takes an uncached transition. Total TC = O(n * m) in the worst case, O(n)
+// with a warm cache
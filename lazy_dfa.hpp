@@ -0,0 +1,175 @@
+#ifndef LAZY_DFA_HPP
+#define LAZY_DFA_HPP
+#include "nfa.hpp"
+#include "pike_vm.hpp"
+#include <span>
+
+// Lazy DFA: determinizes the NFA program on the fly while scanning.
+// A DFA state is the priority-ordered list of NFA states that are active after
+// reading some input. States and their transitions (one per byte class, see
+// ByteClasses) are built the first time they are needed and memoized, so a
+// warm cache costs one table lookup per input byte. When the cache grows past its memory budget it is flushed; if it
+// keeps flushing without making progress the search falls back to the Pike VM.
+//
+// Answers "is there a match", "where does the leftmost-first match end" and,
+// run over a program built by NfaBuilder::build_reverse, "where does it
+// start" or "does a match end here" (and, for a program built by NfaBuilder::build_set, "which patterns
+// match"); captures are left to the other engines.
+class LazyDfa
+{
+public:
+    static constexpr size_t DEFAULT_CACHE_BUDGET = 2 * 1024 * 1024;
+
+    // The program is only read; it must outlive the DFA. A DFA state has no
+    // count, so the program must have no counted loops (see NfaBuilder::expand).
+    explicit LazyDfa(const Program &prog, size_t cache_budget = DEFAULT_CACHE_BUDGET);
+
+    // True if some substring of the input matches
+    bool is_match(std::string_view input);
+
+    // True if the whole input matches
+    bool full_match(std::string_view input);
+
+    // is_match() for every input: matched[i] is the answer for inputs[i]
+    // ('matched' is resized). Up to BATCH_LANES inputs are scanned in
+    // lockstep, one byte of each per round, so their table lookups overlap
+    // instead of each waiting for the one before, which is what bounds a
+    // single scan over a warm cache.
+    static constexpr size_t BATCH_LANES = 4;
+    void is_match_batch(std::span<const std::string_view> inputs, std::vector<bool> &matched);
+
+    // End of the leftmost-first match (the one PikeVM::search reports), or
+    // std::string_view::npos if there is none
+    size_t find_end(std::string_view input);
+
+    // For a program built by NfaBuilder::build_reverse, with a match of the
+    // original pattern known to end at 'end': the smallest position 'start'
+    // such that input[start, end) matches, found by scanning backwards from
+    // 'end'. That is where the leftmost-first match ending at 'end' starts.
+    // Returns std::string_view::npos if no match ends at 'end'.
+    size_t find_start(std::string_view input, size_t end);
+
+    // For a program built by NfaBuilder::build_reverse: whether a match of
+    // the original pattern ends at 'end', found by scanning backwards from
+    // 'end' and stopping as soon as the answer is known. Reads at most
+    // 'limit' bytes and subtracts what it reads; returns 1 (yes), 0 (no) or
+    // -1 if the limit ran out first.
+    int ends_at(std::string_view input, size_t end, size_t &limit);
+
+    // Progress of a search over input that arrives in pieces (see StreamMatcher).
+    // Offsets are absolute: counted from the first byte of the first piece.
+    struct Scan {
+        int state = DEAD;
+        size_t offset = 0;                      // bytes fed so far
+        size_t end = std::string_view::npos;    // end of the last match seen
+        bool settled = false;                   // no later byte can change 'end'
+    };
+
+    // Resumable form of find_end(): begin(), then feed() every piece in
+    // order, then finish() once the input ends. 'end' settles on the same
+    // value find_end() returns for the concatenated input. Pieces are not
+    // retained. The DFA must not run other searches while a scan is in
+    // progress, since those may renumber its states.
+    void begin(Scan &scan);
+    void feed(Scan &scan, std::string_view piece);
+    void finish(Scan &scan);
+
+    // For a set program: the indices of every pattern that matches somewhere
+    // in the input, in increasing order. All patterns are searched in the same
+    // pass. This search never falls back to the Pike VM; a thrashing cache
+    // only makes it slower.
+    void which_match(std::string_view input, std::vector<size_t> &patterns);
+
+    size_t num_flushes() const { return flushes; }
+    // Bytes the state cache holds now, as counted against its budget
+    size_t memory_usage() const { return memory_used; }
+    size_t num_fallbacks() const { return fallbacks; }
+
+private:
+    // DFA state ids with a special meaning
+    static constexpr int DEAD = 0;      // no NFA state left alive
+    static constexpr int UNKNOWN = -1;  // transition not computed yet
+    static constexpr int GAVE_UP = -2;  // cache is thrashing, use the Pike VM
+
+    // Entry of a state list standing for "start a new thread here" (unanchored search)
+    static constexpr uint32_t RESTART = std::numeric_limits<uint32_t>::max();
+
+    // First element of a key: how the list was built
+    static constexpr uint32_t MODE_SEARCH = 0;  // unanchored, leftmost-first
+    static constexpr uint32_t MODE_FULL = 1;    // anchored, whole input must match
+    static constexpr uint32_t MODE_SET = 2;     // unanchored, every thread kept, for which_match()
+    // Only names a start state: a MODE_FULL search that starts away from
+    // position 0, where '^' does not hold
+    static constexpr uint32_t MODE_FULL_MID = 3;
+
+    // A DFA state is identified by its mode followed by its NFA state list
+    using Key = std::vector<uint32_t>;
+    struct KeyHash {
+        size_t operator()(const Key &k) const;
+    };
+
+    struct DState {
+        const Key *key;     // points into 'cache' (node-based, so the address is stable)
+        bool is_match;      // a MATCH state is on the list
+        int8_t eof_match;   // match at end of input: -1 = not computed, 0 = no, 1 = yes
+    };
+
+    // Patterns matched by a MODE_SET state, as ranges of 'pattern_ids'
+    struct SetInfo {
+        uint32_t first = 0, count = 0;          // on the list
+        uint32_t eof_first = 0, eof_count = 0;  // at end of input, once eof_computed
+        bool eof_computed = false;
+        uint32_t reported = 0;                  // 'report_stamp' of the last search that reported it
+    };
+
+    size_t state_cost(size_t len) const;
+    int start_state(uint32_t mode);
+    int transition(int from, unsigned char byte, size_t pos);
+    int add_state(Key key);
+    bool eof_match(int id, bool at_start);
+    void eof_patterns(Key &list, int id, bool at_start);
+    void report(uint32_t first, uint32_t count, std::vector<size_t> &patterns);
+    void flush();
+
+    void closure(Key &list, StateId s, bool at_start, bool at_end);
+    void next_stamp();
+
+    const Program &prog;
+    ByteClasses classes;    // copied next to the table for locality
+    size_t stride;          // transitions per state: classes.count
+
+    // Scratch for closure(): stamp per NFA state, equal to 'stamp' when visited
+    std::vector<uint32_t> visited;
+    uint32_t stamp = 0;
+    std::vector<StateId> stack;
+
+    // The cache
+    std::unordered_map<Key, int, KeyHash> cache;
+    std::vector<DState> states;
+    std::vector<int> trans;                     // 'stride' entries per state
+    int start_ids[4] = {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN};
+    // Kept across flushes: a transition back to this list after a flush is
+    // the search start state again, which the prefilter skips from
+    Key search_start_key;
+    std::vector<SetInfo> set_info;              // parallel to 'states'
+    std::vector<uint32_t> pattern_ids;
+    std::vector<bool> found;                    // which_match(): per pattern
+    uint32_t report_stamp = 0;
+    size_t num_patterns = 0;
+    size_t budget;
+    size_t memory_used = 0;
+
+    // Thrash detection for the current search. Searches over a set, over a
+    // reversed program or over a stream have no fallback and keep going on a
+    // thrashing cache.
+    bool may_give_up = true;
+    size_t search_flushes = 0;
+    size_t last_flush_pos = 0;
+
+    size_t flushes = 0;
+    size_t fallbacks = 0;
+
+    PikeVM fallback;
+};
+
+#endif  // LAZY_DFA_HPP
@@ -0,0 +1,13 @@
+#ifndef MATCH_HPP
+#define MATCH_HPP
+#include "std.hpp"
+
+// Value of a capture slot that was never written
+constexpr size_t NO_POS = static_cast<size_t>(-1);
+
+// Capture registers filled by the matchers
+// Slot 2k holds the start of group k and slot 2k+1 its end (same layout as
+// State::save_id). Group 0 is the whole match and is always present.
+using Captures = std::vector<size_t>;
+
+#endif  // MATCH_HPP
@@ -1,8 +1,10 @@
 #ifndef NFA_HPP
 #define NFA_HPP
-#include "tokenizer.hpp"
+#include "ast.hpp"
+#include "byte_classes.hpp"
+#include "prefilter.hpp"
 
-enum class StateType{
+enum class StateType : uint8_t {
     CHAR,
     DOT,
     CHAR_CLASS,
@@ -10,53 +12,195 @@ enum class StateType{
     SPLIT,
     SAVE,
     ANCHOR_START,
-    ANCHOR_END
+    ANCHOR_END,
+    REPEAT,     // counted loop, see Counter
+    NEXT        // end of one pass through the body of a REPEAT
 };
 
+// States are addressed by their index in Program::states
+using StateId = uint32_t;
+constexpr StateId NO_STATE = std::numeric_limits<StateId>::max();  // dangling transition
+
+// One instruction of the NFA program (16 bytes)
 struct State {
     StateType type;
-    char c;
+    char c = '\0';
     // Valid only when type == StateType::CHAR; value is unspecified otherwise.
 
-    int save_id = -1;
-    // For capture groups: store input positions
-    // even = group start, odd = group end
+    bool negated = false;   // when type == StateType::CHAR_CLASS
 
-    // when type == StateType::CHAR_CLASS
-    std::vector<CharRange> ranges;
-    bool negated = false;
+    union {
+        int save_id = -1;
+        // For capture groups: store input positions
+        // even = group start, odd = group end
+
+        uint32_t cls;
+        // when type == StateType::CHAR_CLASS: index into Program::classes
+
+        uint32_t pattern;
+        // when type == StateType::MATCH: index of the pattern (see NfaBuilder::build_set)
 
-    State* out = nullptr;       // transition1
-    State* out1 = nullptr;      // optional transition2 (only for SPLIT)
+        uint32_t counter;
+        // when type == StateType::REPEAT or StateType::NEXT: index into Program::counters
+    };
 
-    int last_list = -1; 
-    // Marks whether this state has already been added to the current active-states list,
-    // preventing duplicate entries and infinite ε-transition loops
+    StateId out = NO_STATE;     // transition1
+    StateId out1 = NO_STATE;    // optional transition2 (only for SPLIT and REPEAT)
 
     State(StateType t) : type(t) {}
 };
+static_assert(sizeof(State) == 16, "State should stay a compact fixed-size instruction");
+
+// Bounds of a counted loop x{min,max} that NfaBuilder did not expand into
+// copies of x. Its REPEAT state leads to the body x through 'out' and out of
+// the loop through 'out1'; every exit of the body goes to a NEXT state, which
+// leads back to the REPEAT. An engine that follows counters carries a count
+// with each thread: NEXT adds one, the REPEAT enters the body while the count
+// is below max and leaves (resetting the count to 0) once it is at least min,
+// with the body first. The count only grows up to limit(): once min is
+// reached, x{min,} has nothing more to count.
+// Bodies hold no counter of their own, so a thread has at most one count.
+struct Counter {
+    int min;
+    int max;    // -1: no upper bound
+
+    uint32_t limit() const { return static_cast<uint32_t>(max == -1 ? min : max); }
+};
+
+// The compiled NFA: all states in one contiguous array, linked by index, with
+// the ranges of every character class stored back to back in a side table
+struct Program {
+    std::vector<State> states;
+    std::vector<CharRange> ranges;
+    std::vector<ClassRef> classes;
+    std::vector<Counter> counters;  // empty unless NfaBuilder was asked for counters
+    StateId start = NO_STATE;
+    size_t num_slots = 2;   // capture registers, including group 0
+    bool anchored = false;      // every match starts at position 0 ('^' on every path)
+    ByteClasses byte_classes;   // alphabet compression shared by the DFAs
+    Prefilter prefilter;        // skips input where no match can start
+
+    size_t size() const { return states.size(); }
+    size_t memory_usage() const {
+        return states.size() * sizeof(State) + ranges.size() * sizeof(CharRange) + classes.size() * sizeof(ClassRef) +
+               counters.size() * sizeof(Counter);
+    }
+    const State &operator[](StateId id) const { return states[id]; }
+
+    // True if a consuming state (CHAR, DOT or CHAR_CLASS) accepts the byte 'c'
+    // DOT accepts every byte except '\n'
+    bool accepts(const State &s, char c) const {
+        switch (s.type) {
+            case StateType::CHAR:
+                return s.c == c;
+            case StateType::DOT:
+                return c != '\n';
+            case StateType::CHAR_CLASS: {
+                const ClassRef &cr = classes[s.cls];
+                bool in_class = false;
+                for (uint32_t k = cr.first; k < cr.first + cr.count; k++) {
+                    if (ranges[k].lo <= c && c <= ranges[k].hi) {
+                        in_class = true;
+                        break;
+                    }
+                }
+                return in_class != s.negated;
+            }
+            default:
+                return false;
+        }
+    }
+};
+
+// Numbers the (state, count) pairs of a program for the engines that follow
+// counters. Pair (s, 0) is numbered s; the pairs with a count of 1 or more
+// exist for the REPEAT, the body and the NEXT of each loop, and are numbered
+// after the states, loop after loop. Without counters the pairs are the
+// states. Numbering takes one walk over the bodies.
+class CountedStates
+{
+public:
+    explicit CountedStates(const Program &prog) : total(prog.size()){
+        if (prog.counters.empty()) return;
+        first.assign(prog.size(), 0);
+        limits.assign(prog.size(), 0);
+        std::vector<StateId> stack;
+        for (StateId r = 0; r < prog.size(); r++){
+            if (prog[r].type != StateType::REPEAT) continue;
+            const size_t limit = prog.counters[prog[r].counter].limit();
+            stack.assign(1, r);
+            while (!stack.empty()){
+                StateId id = stack.back();
+                stack.pop_back();
+                if (id == NO_STATE || first[id] != 0) continue;
+                first[id] = total;
+                limits[id] = static_cast<uint32_t>(limit);
+                total += limit;
+                const State &s = prog[id];
+                if (s.type == StateType::NEXT) continue;
+                stack.push_back(s.out);
+                if (s.type != StateType::REPEAT) stack.push_back(s.out1);   // not out of the loop
+            }
+        }
+    }
+
+    // Number of pairs, which is also the number of states the program
+    // would have with its loops expanded
+    size_t size() const { return total; }
+
+    size_t operator()(StateId s, uint32_t count) const { return count == 0 ? s : first[s] + count - 1; }
+
+    // Highest count state 's' can have, 0 outside the loops
+    uint32_t limit(StateId s) const { return limits.empty() ? 0 : limits[s]; }
+
+private:
+    std::vector<size_t> first;      // number of (s, 1), for states in a loop
+    std::vector<uint32_t> limits;
+    size_t total;
+};
+
+// A dangling transition of a fragment: field 'out' (alt = false) or 'out1'
+// (alt = true) of state 'id'. Exits of a fragment form a singly linked list
+// allocated in the builder's arena.
+struct Exit {
+    StateId id;
+    bool alt;
+    Exit *next;
+};
 
 // Frag represents a start state and a list of "dangling exits" of an NFA fragment
+// Fragments are built bottom-up from the postfix tokens, so the states of a
+// fragment are the contiguous range [first, end of program) while it is the
+// most recently built one.
 struct Frag {
-    State* start;
-    std::vector<State**> out_ptrs;  // stores the address of the pointers which are dangling
+    StateId start;
+    StateId first;
+    Exit *head = nullptr;
+    Exit *tail = nullptr;
 
-    // Constructor for single-exit fragments (like a literal 'a')
-    Frag(State* s) : start(s) {
-        out_ptrs.push_back(&s->out);
+    // Append the exits of 'other' (its list is taken over, in O(1))
+    void append(const Frag &other) {
+        if (!other.head) return;
+        if (tail) tail->next = other.head;
+        else head = other.head;
+        tail = other.tail;
     }
 
-    // Constructor for multi-exit fragments (like alternation or star)
-    Frag(State* s, std::vector<State**> out) : start(s), out_ptrs(out) {}
+    void append(Exit *e) {
+        if (tail) tail->next = e;
+        else head = e;
+        tail = e;
+    }
 
     // Patch (connect) dangling arrows in this fragment
-    void patch(State* s) {
-        for (auto& ptr : out_ptrs) {
-            if (ptr && !*ptr) { // Only patch if the pointer exists and is currently null
-                *ptr = s;
+    void patch(std::vector<State> &states, StateId s) const {
+        for (Exit *e = head; e; e = e->next) {
+            StateId &target = e->alt ? states[e->id].out1 : states[e->id].out;
+            if (target == NO_STATE) { // Only patch if the transition is currently dangling
+                target = s;
             }
         }
     }
 };
 
-#endif  // NFA_HPP
\ No newline at end of file
+#endif  // NFA_HPP
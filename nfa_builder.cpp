@@ -1,252 +1,595 @@
 #include "nfa_builder.hpp"
 
-// Creates a new State object of the given type, stores it in the state pool,
-// and returns a raw pointer to the newly created state
-State *NfaBuilder::create_state(StateType type){
-    state_pool.push_back(std::make_unique<State>(type));
-    return state_pool.back().get();
+// Appends a new State of the given type to the program and returns its index
+StateId NfaBuilder::create_state(StateType type){
+    prog.states.emplace_back(type);
+    return static_cast<StateId>(prog.states.size() - 1);
 }
 
-// Deep copy a fargment's NFA
-// Returns a new Frag with the copied start state and the copied exits
-Frag NfaBuilder::copy_fragment(Frag original){
-    std::unordered_map<State *, State *> old_to_new; // stores the states we have already visited and its cloned copies
-    State *new_start = copy_state(original.start, old_to_new);
-
-    std::vector<State **> new_exits;
-    // Traverse the newly copied states to store adresses of dangling pointers in the new fragment
-    std::unordered_set<State *> visited;  // Remember which states have been already visited
-    // Depth first traversal of the graph:
-    std::stack<State *> s;
-    s.push(new_start);
-    while (!s.empty())  // Loop until there are no more states left to process
-    {
-        State *curr = s.top();
-        s.pop();
-        if (!curr || visited.count(curr)) continue;
-        visited.insert(curr);
-        // If out is null, it's a dangling exit we need to patch later
-        if (!curr->out && curr->type != StateType::MATCH)
+// Appends the ranges of a character class to the shared range table and
+// returns the index of the class
+uint32_t NfaBuilder::add_class(const std::vector<CharRange> &ranges){
+    prog.classes.push_back({static_cast<uint32_t>(prog.ranges.size()), static_cast<uint32_t>(ranges.size())});
+    prog.ranges.insert(prog.ranges.end(), ranges.begin(), ranges.end());
+    return static_cast<uint32_t>(prog.classes.size() - 1);
+}
+
+// Returns a fragment made of the single state 's', whose 'out' is dangling
+Frag NfaBuilder::single(StateId s){
+    Exit *e = new_exit(s, false);
+    return Frag{s, s, e, e};
+}
+
+Exit *NfaBuilder::new_exit(StateId id, bool alt){
+    return arena.make<Exit>(id, alt, nullptr);
+}
+
+// Pops the most recent fragment; a missing operand means the tree is malformed
+Frag NfaBuilder::pop(std::vector<Frag> &stack){
+    if (stack.empty()) throw std::runtime_error("Syntax Error: operator is missing an operand");
+    Frag f = stack.back();
+    stack.pop_back();
+    return f;
+}
+
+// Joins two fragments, 'e1' built before 'e2', into e1 e2 (or e2 e1 when
+// building the reversed program). The result still spans [e1.first, end).
+Frag NfaBuilder::concat(const Frag &e1, const Frag &e2){
+    if (reverse){
+        e2.patch(prog.states, e1.start);
+        return Frag{e2.start, e1.first, e1.head, e1.tail};
+    }
+    e1.patch(prog.states, e2.start);
+    return Frag{e1.start, e1.first, e2.head, e2.tail};
+}
+
+// Appends a copy of the block of 'original', the contiguous states
+// [original.first, end) that only refer to each other, with every transition
+// shifted by the distance between the blocks. Returns that distance: state
+// 'id' of the original is state 'id + offset' of the copy. No exit list is
+// made for the copy; see patch_copy().
+StateId NfaBuilder::copy_block(const Frag &original, StateId end){
+    std::vector<State> &states = prog.states;
+    StateId offset = static_cast<StateId>(states.size()) - original.first;
+    for (StateId id = original.first; id < end; id++){
+        State copy = states[id];
+        if (copy.out != NO_STATE) copy.out += offset;
+        if (copy.out1 != NO_STATE) copy.out1 += offset;
+        states.push_back(copy);
+    }
+    return offset;
+}
+
+// Connects the dangling exits of the copy of 'original' at 'offset' (0 for
+// 'original' itself) to state 's'. The exits of a copy are those of the
+// original shifted by the offset, so they are found from the original's list.
+void NfaBuilder::patch_copy(const Frag &original, StateId offset, StateId s){
+    for (Exit *e = original.head; e; e = e->next){
+        StateId &target = e->alt ? prog.states[e->id + offset].out1 : prog.states[e->id + offset].out;
+        if (target == NO_STATE) target = s;
+    }
+}
+
+// Expands e{min,max} (max == -1 for no upper bound) into 'min' instances of
+// 'e' in a row followed by either a loop over one more instance or a chain of
+// max - min optional instances, each behind a SPLIT that can take it or leave
+// the repetition.
+// Instances are block copies of 'e' wired to each other through patch_copy(),
+// so a copy costs its states and nothing else (no exit list, no Frag). 'e'
+// itself is the last instance: it is only wired up once every copy has been
+// taken from its untouched block, and its exit list becomes the exits of the
+// repetition.
+// Expanded, the program grows with the counts (.{0,4096} is 8194 states,
+// and nested counts multiply). With counters, a repetition of more than
+// MAX_COPIES instances is a counted loop instead, whose size does not depend
+// on the counts; a body that holds a loop is still copied, each copy with
+// its own loop.
+Frag NfaBuilder::repeat(const Frag &e, int min, int max){
+    std::vector<State> &states = prog.states;
+    const StateId end = static_cast<StateId>(states.size());
+    const int instances = min + (max == -1 ? 1 : max - min);
+    if (loops && instances > MAX_COPIES &&
+        std::none_of(states.begin() + e.first, states.end(), [](const State &s){ return s.type == StateType::REPEAT; })){
+        return counted_loop(e, min, max);
+    }
+    int taken = 0;
+    auto next_instance = [&](){
+        return (++taken == instances) ? StateId{0} : copy_block(e, end);
+    };
+
+    Frag result{NO_STATE, e.first};
+    bool pending = false;   // the instance at 'prev' still has dangling exits
+    StateId prev = 0;
+    // Makes 'target' the continuation of everything built so far
+    auto link = [&](StateId target){
+        if (result.start == NO_STATE) result.start = target;
+        if (pending) patch_copy(e, prev, target);
+        pending = false;
+    };
+
+    // 1. The mandatory part
+    for (int i = 0; i < min; i++){
+        StateId offset = next_instance();
+        link(e.start + offset);
+        pending = true;
+        prev = offset;
+    }
+
+    // 2. The optional part
+    if (max == -1){ // Case {m,}
+        StateId s = create_state(StateType::SPLIT);
+        link(s);
+        StateId offset = next_instance();
+        states[s].out = e.start + offset;
+        patch_copy(e, offset, s);
+        result.append(new_exit(s, true));
+    }else{          // Case {m,n}, nothing more for {m}
+        for (int i = min; i < max; i++){
+            StateId s = create_state(StateType::SPLIT);
+            link(s);
+            StateId offset = next_instance();
+            states[s].out = e.start + offset;
+            result.append(new_exit(s, true));
+            pending = true;
+            prev = offset;
+        }
+        // If every instance is taken, the match continues after the last one,
+        // which is 'e' itself
+        if (pending) result.append(e);
+    }
+
+    // e{0} matches the empty string: a lone SPLIT takes the place of the
+    // block of 'e', which nothing refers to
+    if (result.start == NO_STATE){
+        states.erase(states.begin() + e.first, states.end());
+        result = single(create_state(StateType::SPLIT));
+    }
+    result.first = e.first;
+    return result;
+}
+
+// REPEAT -> e -> NEXT -> back to the REPEAT, whose 'out1' leaves the loop
+// (see Counter)
+Frag NfaBuilder::counted_loop(const Frag &e, int min, int max){
+    std::vector<State> &states = prog.states;
+    const uint32_t counter = static_cast<uint32_t>(prog.counters.size());
+    prog.counters.push_back({min, max});
+    StateId r = create_state(StateType::REPEAT);
+    states[r].counter = counter;
+    states[r].out = e.start;
+    StateId next = create_state(StateType::NEXT);
+    states[next].counter = counter;
+    states[next].out = r;
+    e.patch(states, next);
+    Exit *x = new_exit(r, true);
+    return Frag{r, e.first, x, x};
+}
+
+// Sizes of the program build() creates for 'ast', worked out from the nodes
+// alone with the same stack discipline the builder uses, so they are exact
+// up to what the optimizer removes. 'counters' is that of build().
+// Counts saturate at NO_STATE: a program that large cannot be built.
+NfaBuilder::Estimate NfaBuilder::estimate(const Ast &ast, bool counters){
+    const size_t cap = NO_STATE;
+    auto add = [&](size_t a, size_t b){ return std::min(a + b, cap); };     // a, b <= cap
+    auto times = [&](size_t a, size_t n){ return (n != 0 && a > cap / n) ? cap : a * n; };
+
+    // Per fragment: its states, how deeply groups and repetitions nest in it
+    // and whether it holds a counted loop
+    struct Size {
+        size_t states;
+        size_t depth;
+        bool loop = false;
+    };
+    std::vector<Size> stack;
+    Estimate result;
+    result.ranges = ast.ranges.size();
+    result.classes = ast.classes.size();
+    auto pop = [&](){
+        if (stack.empty()) throw std::runtime_error("Syntax Error: operator is missing an operand");
+        Size n = stack.back();
+        stack.pop_back();
+        return n;
+    };
+    auto push = [&](size_t states, size_t depth, bool loop = false){
+        result.depth = std::max(result.depth, depth);
+        stack.push_back({states, depth, loop});
+    };
+
+    for (const auto &t : ast.nodes){
+        switch (t.type){
+        case TokenType::LITERAL:
+        case TokenType::DOT:
+        case TokenType::CHAR_CLASS:
+        case TokenType::CARET:
+        case TokenType::DOLLAR:
+        case TokenType::LPAREN:
+            push(1, 0);
+            break;
+        case TokenType::RPAREN:
         {
-            new_exits.push_back(&curr->out);
+            Size content = pop();
+            Size lparen = pop();
+            push(add(add(lparen.states, content.states), 1), content.depth + 1, content.loop);
+            break;
         }
-        // If out1 is null (and it's a SPLIT state), it's also an exit
-        if (!curr->out1 && curr->type == StateType::SPLIT)
+        case TokenType::CONCAT:
+        case TokenType::ALTERNATION:
         {
-            new_exits.push_back(&curr->out1);
+            Size e2 = pop();
+            Size e1 = pop();
+            push(add(add(e1.states, e2.states), t.type == TokenType::ALTERNATION ? 1 : 0), std::max(e1.depth, e2.depth),
+                 e1.loop || e2.loop);
+            break;
         }
+        case TokenType::STAR:
+        case TokenType::PLUS:
+        case TokenType::QUESTION:
+        {
+            Size e = pop();
+            push(add(e.states, 1), e.depth + 1, e.loop);
+            break;
+        }
+        case TokenType::QUANTIFIER_RANGE:
+        {
+            // See repeat(); with no instance at all a SPLIT replaces the block of 'e'
+            Size e = pop();
+            size_t optional = (t.max == -1) ? 1 : static_cast<size_t>(t.max - t.min);
+            size_t instances = static_cast<size_t>(t.min) + optional;
+            if (counters && instances > MAX_COPIES && !e.loop){
+                result.counters++;
+                push(add(e.states, 2), e.depth + 1, true);     // REPEAT, NEXT
+                break;
+            }
+            push(instances == 0 ? 1 : add(times(e.states, instances), optional), e.depth + 1, e.loop);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    size_t total = stack.empty() ? 1 : 0;  // empty regex
+    for (const Size &n : stack) total = add(total, n.states);
+    result.states = add(total, 1);          // MATCH
+    return result;
+}
 
-        if (curr->out) s.push(curr->out);
-        if (curr->out1) s.push(curr->out1);
+// Starts a new program sized for the given patterns: the sizes are known up
+// front, so each table is allocated exactly once. Throws if the program would
+// not be addressable with 32-bit state indices.
+void NfaBuilder::start_program(const std::vector<const Ast *> &asts){
+    // All Frag exit lists of the previous build are released at once
+    arena.reset();
+    prog = Program();
+
+    const size_t limit = static_cast<size_t>(NO_STATE) - 1;
+    size_t num_states = asts.size() > 1 ? asts.size() - 1 : 0;   // SPLITs of a set
+    size_t num_ranges = 0, num_classes = 0, num_counters = 0;
+    for (const Ast *ast : asts){
+        Estimate size = estimate(*ast, loops);
+        if (size.states > limit - std::min(num_states, limit)){
+            throw CompileError(CompileError::Kind::STATES, std::min(num_states + size.states, limit + 1), limit);
+        }
+        num_states += size.states;
+        num_ranges += size.ranges;
+        num_classes += size.classes;
+        num_counters += size.counters;
     }
+    prog.states.reserve(num_states);
+    prog.ranges.reserve(num_ranges);
+    prog.classes.reserve(num_classes);
+    prog.counters.reserve(num_counters);
+}
 
-    return Frag(new_start, new_exits);
+// True if no consuming state and no MATCH can be reached from the start
+// without going through a '^'. In a program built by build_reverse() that
+// means every match of the original pattern ends at the end of the input.
+bool NfaBuilder::anchored_at_start(const Program &prog){
+    std::vector<bool> visited(prog.size(), false);
+    std::vector<StateId> stack{prog.start};
+    while (!stack.empty()){
+        StateId id = stack.back();
+        stack.pop_back();
+        if (id == NO_STATE || visited[id]) continue;
+        visited[id] = true;
+        const State &curr = prog[id];
+        switch (curr.type){
+        case StateType::SPLIT:
+            stack.push_back(curr.out);
+            stack.push_back(curr.out1);
+            break;
+        case StateType::REPEAT:     // either way, whatever the count
+            stack.push_back(curr.out);
+            stack.push_back(curr.out1);
+            break;
+        case StateType::SAVE:
+        case StateType::ANCHOR_END:
+        case StateType::NEXT:
+            stack.push_back(curr.out);
+            break;
+        case StateType::ANCHOR_START:
+            break;
+        default:    // CHAR, DOT, CHAR_CLASS, MATCH
+            return false;
+        }
+    }
+    return true;
 }
 
-// Deep copy a NFA subgraph starting from state 's'
-// Creates new State objects for all reachable states (except MATCH)
-// Returns a pointer to the copied version of 's'
-State *NfaBuilder::copy_state(State *s, std::unordered_map<State *, State *> &lookup){
-    // 'lookup' stores the states which are already 
-    // copied. map: key = old_state, value = new_state (copy of the old_state)
-
-    if (!s || s->type == StateType::MATCH) return s;    // If state is null or is the final MATCH state, return it as is
-    if (lookup.count(s)) return lookup[s];  // If this state was already copied, return the existing copy
-
-    // Create a new state with the same type and copy fields
-    State *result = create_state(s->type);
-    result->c = s->c;
-    result->ranges = s->ranges;
-    result->negated = s->negated;
-    result->save_id = s->save_id;
-    lookup[s] = result; // Remember that this original state is now copied
-
-    // Recursively copy outgoing transitions
-    result->out = copy_state(s->out, lookup);
-    result->out1 = copy_state(s->out1, lookup);
-    return result;
+// Builds an NFA from a parsed regex pattern.
+// Returns the constructed program; its start state is Program::start.
+// The byte classes and the prefilter are computed from the optimized program.
+Program NfaBuilder::build(const Ast &ast, bool captures, bool counters){
+    loops = counters;
+    const Ast &tree = rewriter.rewrite(ast, captures, rewritten) ? rewritten : ast;
+    start_program({&tree});
+
+    // Connect all dangling exits of the pattern to a single MATCH state
+    Frag frag = build_fragment(tree);
+    StateId match_state = create_state(StateType::MATCH);
+    prog.states[match_state].pattern = 0;
+    frag.patch(prog.states, match_state);
+
+    prog.start = frag.start;
+    optimizer.optimize(prog, captures ? NfaOptimizer::ALL_GROUPS : 1);
+    prog.anchored = anchored_at_start(prog);
+    prog.byte_classes = ByteClasses::compute(prog);
+    prog.prefilter = Prefilter::compute(prog, tree);
+    return std::move(prog);
 }
 
-// Builds an NFA from a tokenized postfix regex pattern.
-// Iterates the postfix tokens, pushed and combines NFA fragments on a stack
-// according to each operator, and finally connects all remaining dangling 
-// exits to a single MATCH state.
-// Returns a pointer to the start state of the constructed NFA, or nullptr if
-// the input is empty.
-State *NfaBuilder::build(const std::vector<Token> &postfix){
-    std::stack<Frag> stack;
+// Same construction as build(), with every concatenation wired the other way
+// round. Capture registers mean nothing in the reversed program, so its SAVE
+// states are dropped. No prefilter: the program is run backwards from a known
+// match end.
+Program NfaBuilder::build_reverse(const Ast &ast, bool counters){
+    reverse = true;
+    loops = counters;
+    struct Reset {
+        bool &flag;
+        ~Reset() { flag = false; }
+    } reset{reverse};
+
+    const Ast &tree = rewriter.rewrite(ast, false, rewritten) ? rewritten : ast;
+    start_program({&tree});
+    Frag frag = build_fragment(tree);
+    StateId match_state = create_state(StateType::MATCH);
+    prog.states[match_state].pattern = 0;
+    frag.patch(prog.states, match_state);
 
-    for (const auto &t : postfix){
+    prog.start = frag.start;
+    optimizer.optimize(prog, 1);
+    prog.anchored = anchored_at_start(prog);
+    prog.byte_classes = ByteClasses::compute(prog);
+    prog.prefilter = Prefilter::compute(prog, {});
+    return std::move(prog);
+}
+
+// Builds one program matching any of the patterns. Every pattern ends in its
+// own MATCH state tagged with the pattern's index, and the start state is a
+// chain of SPLITs that tries the patterns in order. A set reports which
+// patterns match, not where their groups are, so no captures are kept.
+Program NfaBuilder::build_set(const std::vector<Ast> &asts){
+    loops = false;
+    std::vector<Ast> trees(asts.size());
+    std::vector<const Ast *> all;
+    for (size_t i = 0; i < asts.size(); i++){
+        all.push_back(rewriter.rewrite(asts[i], false, trees[i]) ? &trees[i] : &asts[i]);
+    }
+    start_program(all);
+
+    std::vector<StateId> starts;
+    for (size_t i = 0; i < asts.size(); i++){
+        Frag frag = build_fragment(*all[i]);
+        StateId match_state = create_state(StateType::MATCH);
+        prog.states[match_state].pattern = static_cast<uint32_t>(i);
+        frag.patch(prog.states, match_state);
+        starts.push_back(frag.start);
+    }
+
+    if (starts.empty()){
+        // An empty set matches nothing: a class without ranges accepts no byte
+        StateId s = create_state(StateType::CHAR_CLASS);
+        prog.states[s].cls = add_class({});
+        starts.push_back(s);
+    }
+    StateId start = starts.back();
+    for (size_t i = starts.size() - 1; i-- > 0;){
+        StateId s = create_state(StateType::SPLIT);
+        prog.states[s].out = starts[i];
+        prog.states[s].out1 = start;
+        start = s;
+    }
+
+    prog.start = start;
+    optimizer.optimize(prog, 1);
+    prog.anchored = anchored_at_start(prog);
+    prog.byte_classes = ByteClasses::compute(prog);
+    prog.prefilter = Prefilter::compute(prog, {});
+    return std::move(prog);
+}
+
+// Every (state, count) pair of the program becomes a state of its own (see
+// CountedStates), wired the way an engine that follows the counts moves
+// between the pairs: a REPEAT with a count becomes a SPLIT into the body and
+// out of the loop, or a jump to the one of them the count allows, and a NEXT
+// a jump to the REPEAT with the next count. That is repeat()'s expansion
+// with a jump between every two instances, which the optimizer steps over.
+Program NfaBuilder::expand(const Program &counted){
+    if (counted.counters.empty()) return counted;
+    const CountedStates pairs(counted);
+    const size_t limit = static_cast<size_t>(NO_STATE) - 1;
+    if (pairs.size() > limit) throw CompileError(CompileError::Kind::STATES, pairs.size(), limit);
+
+    Program prog;
+    prog.states.assign(pairs.size(), State(StateType::SPLIT));
+    prog.ranges = counted.ranges;
+    prog.classes = counted.classes;
+    prog.num_slots = counted.num_slots;
+    prog.start = counted.start;
+    auto to = [&](StateId s, uint32_t count){
+        return s == NO_STATE ? NO_STATE : static_cast<StateId>(pairs(s, count));
+    };
+    for (StateId id = 0; id < counted.size(); id++){
+        const State &s = counted[id];
+        for (uint32_t count = 0; count <= pairs.limit(id); count++){
+            State &copy = prog.states[pairs(id, count)];
+            if (s.type == StateType::REPEAT){
+                const Counter &k = counted.counters[s.counter];
+                copy.out = (k.max == -1 || count < static_cast<uint32_t>(k.max)) ? to(s.out, count) : NO_STATE;
+                copy.out1 = count >= static_cast<uint32_t>(k.min) ? to(s.out1, 0) : NO_STATE;
+            }else if (s.type == StateType::NEXT){
+                copy.out = to(s.out, std::min(count + 1, counted.counters[s.counter].limit()));
+            }else{
+                copy = s;
+                copy.out = to(s.out, count);
+                copy.out1 = to(s.out1, count);
+            }
+        }
+    }
+
+    NfaOptimizer().optimize(prog);
+    prog.anchored = anchored_at_start(prog);
+    prog.byte_classes = counted.byte_classes;
+    prog.prefilter = counted.prefilter;
+    return prog;
+}
+
+// Builds the fragment of one pattern into the current program.
+// Iterates the nodes in postfix order, pushes and combines NFA fragments on
+// a stack according to each operator; whatever remains is implicitly
+// concatenated. The pattern's interned classes are appended to the program's
+// class table as they are.
+Frag NfaBuilder::build_fragment(const Ast &ast){
+    std::vector<State> &states = prog.states;
+    const uint32_t class_base = static_cast<uint32_t>(prog.classes.size());
+    const uint32_t range_base = static_cast<uint32_t>(prog.ranges.size());
+    for (const ClassRef &c : ast.classes) prog.classes.push_back({range_base + c.first, c.count});
+    prog.ranges.insert(prog.ranges.end(), ast.ranges.begin(), ast.ranges.end());
+
+    std::vector<Frag> stack;
+    stack.reserve(ast.nodes.size());
+
+    for (const auto &t : ast.nodes){
         switch (t.type){
         case TokenType::LITERAL:
         {
-            State *s = create_state(StateType::CHAR);
-            s->c = t.literal;
-            stack.push(Frag(s));
+            StateId s = create_state(StateType::CHAR);
+            states[s].c = t.literal;
+            stack.push_back(single(s));
             break;
         }
         case TokenType::DOT:
         {
-            stack.push(Frag(create_state(StateType::DOT)));
+            stack.push_back(single(create_state(StateType::DOT)));
             break;
         }
         case TokenType::CHAR_CLASS:
         {
-            State *s = create_state(StateType::CHAR_CLASS);
-            s->ranges = t.ranges;
-            s->negated = t.negated;
-            stack.push(Frag(s));
+            StateId s = create_state(StateType::CHAR_CLASS);
+            states[s].cls = class_base + t.cls;
+            states[s].negated = t.negated;
+            stack.push_back(single(s));
             break;
         }
         case TokenType::CARET:
         {
-            stack.push(Frag(create_state(StateType::ANCHOR_START)));
+            stack.push_back(single(create_state(reverse ? StateType::ANCHOR_END : StateType::ANCHOR_START)));
             break;
         }
         case TokenType::DOLLAR:
         {
-            stack.push(Frag(create_state(StateType::ANCHOR_END)));
+            stack.push_back(single(create_state(reverse ? StateType::ANCHOR_START : StateType::ANCHOR_END)));
             break;
         }
         case TokenType::LPAREN:
         {
-            State *s = create_state(StateType::SAVE);
-            s->save_id = t.group_id * 2; // Start register (even)
-            stack.push(Frag(s));
+            StateId s = create_state(StateType::SAVE);
+            states[s].save_id = t.group_id * 2; // Start register (even)
+            stack.push_back(single(s));
             break;
         }
         case TokenType::RPAREN:
         {
             // Create the save (end) state
-            State *s = create_state(StateType::SAVE);
-            s->save_id = t.group_id * 2 + 1; // End register (odd)
+            StateId s = create_state(StateType::SAVE);
+            states[s].save_id = t.group_id * 2 + 1; // End register (odd)
+            prog.num_slots = std::max(prog.num_slots, static_cast<size_t>(t.group_id + 1) * 2);
             
             // Extract the content of the group along with save (start)
-            Frag content = stack.top();
-            stack.pop();
-            Frag lparen_frag = stack.top();
-            stack.pop();
-            lparen_frag.patch(content.start);
-            content.patch(s);
+            Frag content = pop(stack);
+            Frag lparen_frag = pop(stack);
+            if (reverse){
+                // save (end) -> content -> save (start)
+                states[s].out = content.start;
+                content.patch(states, lparen_frag.start);
+                stack.push_back(Frag{s, lparen_frag.first, lparen_frag.head, lparen_frag.tail});
+                break;
+            }
+            lparen_frag.patch(states, content.start);
+            content.patch(states, s);
 
             // Push the whole fragment
-            stack.push(Frag(lparen_frag.start, {&s->out}));
+            Exit *e = new_exit(s, false);
+            stack.push_back(Frag{lparen_frag.start, lparen_frag.first, e, e});
             break;
         }
         case TokenType::CONCAT:
         {
-            Frag e2 = stack.top();
-            stack.pop();
-            Frag e1 = stack.top();
-            stack.pop();
-            e1.patch(e2.start);
-            stack.push(Frag(e1.start, e2.out_ptrs));
+            Frag e2 = pop(stack);
+            Frag e1 = pop(stack);
+            stack.push_back(concat(e1, e2));
             break;
         }
         case TokenType::ALTERNATION:
         {
-            Frag e2 = stack.top();
-            stack.pop();
-            Frag e1 = stack.top();
-            stack.pop();
-            State *s = create_state(StateType::SPLIT);
-            s->out = e1.start;
-            s->out1 = e2.start;
+            Frag e2 = pop(stack);
+            Frag e1 = pop(stack);
+            StateId s = create_state(StateType::SPLIT);
+            states[s].out = e1.start;
+            states[s].out1 = e2.start;
             // Combine dangling exits from both branches
-            std::vector<State **> combined = e1.out_ptrs;
-            combined.insert(combined.end(), e2.out_ptrs.begin(), e2.out_ptrs.end());
-            stack.push(Frag(s, combined));
+            Frag combined{s, e1.first, e1.head, e1.tail};
+            combined.append(e2);
+            stack.push_back(combined);
             break;
         }
         case TokenType::STAR:
         {
-            Frag e = stack.top();
-            stack.pop();
-            State *s = create_state(StateType::SPLIT);
-            s->out = e.start;                // Loop back into the expression
-            e.patch(s);                      // The expression's end loops back to the split
-            stack.push(Frag(s, {&s->out1})); // out1 is the escape route
+            Frag e = pop(stack);
+            StateId s = create_state(StateType::SPLIT);
+            states[s].out = e.start;           // Loop back into the expression
+            e.patch(states, s);                // The expression's end loops back to the split
+            Exit *x = new_exit(s, true);       // out1 is the escape route
+            stack.push_back(Frag{s, e.first, x, x});
             break;
         }
         case TokenType::PLUS:
         {
-            Frag e = stack.top();
-            stack.pop();
-            State *s = create_state(StateType::SPLIT);
-            s->out = e.start; // Loop back
-            e.patch(s);       // Connect expression end to split
-            stack.push(Frag(e.start, {&s->out1}));
+            Frag e = pop(stack);
+            StateId s = create_state(StateType::SPLIT);
+            states[s].out = e.start; // Loop back
+            e.patch(states, s);      // Connect expression end to split
+            Exit *x = new_exit(s, true);
+            stack.push_back(Frag{e.start, e.first, x, x});
             break;
         }
         case TokenType::QUESTION:
         {
-            Frag e = stack.top();
-            stack.pop();
-            State *s = create_state(StateType::SPLIT);
-            s->out = e.start; // Option 1: match the expression
+            Frag e = pop(stack);
+            StateId s = create_state(StateType::SPLIT);
+            states[s].out = e.start; // Option 1: match the expression
             // Option 2: skip the expression (out1)
-            std::vector<State **> exits = e.out_ptrs;
-            exits.push_back(&s->out1);
-            stack.push(Frag(s, exits));
+            Frag result{s, e.first, e.head, e.tail};
+            result.append(new_exit(s, true));
+            stack.push_back(result);
             break;
         }
         case TokenType::QUANTIFIER_RANGE:
         {
-            Frag e = stack.top();
-            stack.pop();
-
-            // 1. Handle the mandatory part (m)
-            // Initialize 'mandatory' with an immediately-invoked lambda (no valid default state).
-            Frag mandatory = [&](){
-                if (t.min == 0){
-                    State *eps = create_state(StateType::SPLIT);
-                    return Frag(eps, {&eps->out});
-                }else{
-                    return copy_fragment(e); // Use the first one as the base
-                }
-            }();
-            // If min > 1, append the necessary copies
-            for (int i = 1; i < t.min; i++){
-                Frag next_copy = copy_fragment(e);
-                mandatory.patch(next_copy.start);
-                mandatory = Frag(mandatory.start, next_copy.out_ptrs);
-            }
-
-            // 2. Handle the optional part (n - m) or infinite (m, )
-            if (t.max == -1){ // Case {m,}
-                State *s = create_state(StateType::SPLIT);
-                Frag loop_part = copy_fragment(e);
-
-                s->out = loop_part.start;
-                loop_part.patch(s);
-
-                mandatory.patch(s);
-                stack.push(Frag(mandatory.start, {&s->out1}));
-            }else if (t.max > t.min){ // Case {m,n}
-                // Build a chain of optional fragments, each one guarded by a SPLIT that can either
-                // take the repetition or skip it and move on
-                Frag optional_chain = mandatory;
-                std::vector<State **> all_exits;
-
-                for (int i = 0; i < (t.max - t.min); i++){
-                    Frag next_opt = copy_fragment(e);
-                    State *s = create_state(StateType::SPLIT);
-
-                    s->out = next_opt.start;
-                    optional_chain.patch(s);
-
-                    // Collect exits from the skip path
-                    all_exits.push_back(&s->out1);
-
-                    optional_chain = Frag(next_opt.start, next_opt.out_ptrs);
-                }
-                // Add exits from the last repetition: if all optional parts are taken,
-                // the match can continue after the final copied fragment.
-                all_exits.insert(all_exits.end(), optional_chain.out_ptrs.begin(), optional_chain.out_ptrs.end());
-                stack.push(Frag(mandatory.start, all_exits));
-            }else{  // Case {m} (exactly m)
-                stack.push(mandatory);
-            }
+            Frag e = pop(stack);
+            stack.push_back(repeat(e, t.min, t.max));
             break;
         }
         default:
@@ -256,46 +599,58 @@ State *NfaBuilder::build(const std::vector<Token> &postfix){
 
     // If no fragments were built (empty regex)
     if (stack.empty()){
-        State* s = create_state(StateType::SPLIT);
-        stack.push(Frag(s));
+        stack.push_back(single(create_state(StateType::SPLIT)));
     }
 
     // After processing all tokens, ideally there should be exactly one fragment
     // If more than one fragments remain, they are implicitly concatenated
     while (stack.size() > 1)
     {
-        Frag e2 = stack.top();
-        stack.pop();
-        Frag e1 = stack.top();
-        stack.pop();
-        e1.patch(e2.start);
-        stack.push(Frag(e1.start, e2.out_ptrs));
+        Frag e2 = pop(stack);
+        Frag e1 = pop(stack);
+        stack.push_back(concat(e1, e2));
     }
 
-    // Finalize the NFA by patching all dangling exits to a MATCH state
-    Frag final_frag = stack.top();
-    stack.pop();
-    State *match_state = create_state(StateType::MATCH);
-    final_frag.patch(match_state);
-
-    return final_frag.start;
+    return pop(stack);
 }
 
 // Time Complexity Analysis:
 
-// T = number of postfix tokens
+// T = number of AST nodes
 // S = total number of NFA states created, including expansions caused by
 // operators like '*', '+', '?', and '{m, n}'.
 
+// estimate():
+// One pass over the nodes with a stack of fragment sizes → O(T), whatever
+// the size of the program it describes
+
 // create_state():
-// O(1) per call → total O(S)
+// O(1) per call → total O(S); the state table is reserved up front from
+// estimate(), so it is never reallocated
 
-// copy_state(s):
-// Copies each reachable state once → O(k) (k is the number of states reachable from s)
+// copy_block(f), patch_copy(f):
+// One pass over the fragment's block, resp. its exit list → O(k) (k = number
+// of states in the fragment), with no hashing and no allocation
 
-// copy_fragment(f):
-// O(k) (k = number of states in the fragment)
+// repeat(e, m, n):
+// One copy_block() and one patch_copy() per instance → O(n * k); the only
+// allocations are the skip exits of the optional SPLITs. As a counted loop:
+// O(k) to check the body for a loop and patch it, whatever n is
+
+// expand():
+// One state per (state, count) pair, P = O(S * n) of them, then the
+// optimizer → O(P)
 
 // build() function;
-// Total Average TC = O(T + S) (assuming good hash behavior of std::unordered_map and std::unordered_set)
-// The builder therefore runs in time linear in the size of the constructed NFA
\ No newline at end of file
+// Total TC = O(T + S), the optimizer included (see NfaOptimizer), plus
+// rewriting the pattern, O(T) unless its alternatives share prefixes within
+// shared prefixes (see AstRewriter)
+// The builder therefore runs in time linear in the size of the constructed NFA.
+// Apart from the program's three tables, all memory comes from the arena.
+
+// build_reverse():
+// Same as build()
+
+// build_set():
+// One build_fragment() per pattern plus one SPLIT per pattern → O(T + S) over
+// all patterns
@@ -1,33 +1,110 @@
 #ifndef NFA_BUILDER_HPP
 #define NFA_BUILDER_HPP
 #include "nfa.hpp"
-#include "postfix.hpp"
+#include "ast_rewriter.hpp"
+#include "nfa_optimizer.hpp"
+#include "parser.hpp"
+#include "arena.hpp"
+#include "compile_limits.hpp"
 
 class NfaBuilder
 {
 public:
-    // Build an NFA from postfix regex and return its start state.
+    // Build an NFA program from a parsed regex; Program::start is its start state.
     // The NFA's accepting state will have type StateType::MATCH.
-    State *build(const std::vector<Token> &postfix);
-
-    Frag copy_fragment(Frag);
-    State *copy_state(State *, std::unordered_map<State *, State *> &);
+    // Every pattern is simplified by AstRewriter first and every program is
+    // run through NfaOptimizer; with captures = false only group 0 (the whole
+    // match) is kept.
+    // With counters = true, a counted repetition x{m,n} of more than
+    // MAX_COPIES instances becomes a loop over a single copy of x that counts
+    // its passes (see Counter), unless x holds such a loop itself: .{0,4096}
+    // is then 4 states instead of 8194. Only the Pike VM and the backtracker
+    // follow counters; expand() turns such a program back into a plain one.
+    Program build(const Ast &ast, bool captures = true, bool counters = false);
+
+    // Build the program of the reversed pattern: it matches exactly the
+    // reversals of the strings the pattern matches (concatenations run last
+    // to first, '^' and '$' trade places). Scanning it backwards from the end
+    // of a match finds where the match starts. It keeps no captures.
+    Program build_reverse(const Ast &ast, bool counters = false);
+
+    // Build one program for a set of patterns; the MATCH state of pattern i
+    // has State::pattern == i. It keeps no captures.
+    Program build_set(const std::vector<Ast> &asts);
+
+    // The program with every counted loop replaced by its copies, as build()
+    // makes it without counters, for the engines that do not follow counts
+    // (the DFAs). Throws CompileError if it would not be addressable.
+    static Program expand(const Program &prog);
+
+    static constexpr int MAX_COPIES = 256;
+
+    // Size of the program build() will create for 'ast', known before
+    // anything is built (see CompileLimits). The rewriter and the optimizer
+    // only remove states, so the program may turn out smaller.
+    struct Estimate {
+        size_t states = 0;
+        size_t ranges = 0;      // character class ranges
+        size_t classes = 0;
+        size_t counters = 0;
+        size_t depth = 0;       // nesting of groups and repetitions
+
+        // Bytes of the program, as Program::memory_usage() will report them
+        size_t memory() const {
+            return states * sizeof(State) + ranges * sizeof(CharRange) + classes * sizeof(ClassRef) +
+                   counters * sizeof(Counter);
+        }
+    };
+    static Estimate estimate(const Ast &ast, bool counters = false);
 
 private:
-    // Allocate a new state and keep ownership in the internal pool
-    State *create_state(StateType type);
-
-    // Owns all states created during NFA construction
-    // Ensures that all State objects live as long as the NfaBuilder lives
-    // When NfaBuilder is destroyed, state_pool is destroyed, and all State
-    // objects are automatically deleted
-    std::vector<std::unique_ptr<State>> state_pool; // Automatic cleanup (RAII)
+    void start_program(const std::vector<const Ast *> &asts);
+    Frag build_fragment(const Ast &ast);
+    static bool anchored_at_start(const Program &prog);
+
+    // Append a new state to the program and return its index
+    StateId create_state(StateType type);
+
+    // Store the ranges of a character class in the program's side table
+    uint32_t add_class(const std::vector<CharRange> &ranges);
+
+    Frag single(StateId s);
+    Exit *new_exit(StateId id, bool alt);
+    Frag pop(std::vector<Frag> &stack);
+    Frag concat(const Frag &e1, const Frag &e2);
+
+    // Append a copy of the fragment whose states are [original.first, end)
+    // and return its offset from the original
+    StateId copy_block(const Frag &original, StateId end);
+    void patch_copy(const Frag &original, StateId offset, StateId s);
+
+    // Expand the counted repetition e{min,max}, or make it a counted loop
+    Frag repeat(const Frag &e, int min, int max);
+    Frag counted_loop(const Frag &e, int min, int max);
+
+    // The program under construction. States refer to each other by index,
+    // so growing the state vector never invalidates a transition.
+    Program prog;
+
+    // Owns the Frag exit lists of one build; reset (in O(1)) by the next build
+    Arena arena;
+
+    // Run over every pattern and every program built; both keep their side
+    // tables between builds
+    AstRewriter rewriter;
+    Ast rewritten;
+    NfaOptimizer optimizer;
+
+    // Set while build_reverse() runs
+    bool reverse = false;
+    // Set for the current build if counted loops are wanted
+    bool loops = false;
 };
 
 // Debugging tools
 class NfaPrinter {
 public:
-    static void print_nfa(State* start, size_t idx) {
+    static void print_nfa(const Program& prog, size_t idx) {
         std::string dot_file = "nfas/nfa_" + std::to_string(idx) + ".dot";
         std::string png_file = "nfas/nfa_" + std::to_string(idx) + ".png";
         std::ofstream out(dot_file);
@@ -36,11 +113,11 @@ public:
             return;
         }
 
-        std::set<State*> visited;
+        std::set<StateId> visited;
         out << "digraph NFA {\n";
         out << "  rankdir=LR;\n";
         out << "  fontname=\"monospace\";\n";
-        print_state(start, true, visited, out);
+        print_state(prog, prog.start, true, visited, out);
         out << "}\n";
         out.close();
 
@@ -69,38 +146,39 @@ private:
         return std::string(1, c);
     }
 
-    static void print_state(State* s, bool isStart, std::set<State*>& visited, std::ostream& out) {
-        if (!s || visited.count(s)) return;
-        visited.insert(s);
+    static void print_state(const Program& prog, StateId id, bool isStart, std::set<StateId>& visited, std::ostream& out) {
+        if (id == NO_STATE || visited.count(id)) return;
+        visited.insert(id);
+        const State& s = prog[id];
 
         // Node
-        out << "  \"" << s << "\" [label=\"" << (isStart?"(START)\\n":"") << state_label(s) << "\"";
+        out << "  \"s" << id << "\" [label=\"" << (isStart?"(START)\\n":"") << state_label(s) << "\"";
 
         if(isStart) out << ", shape=doublecircle";
-        else if (s->type == StateType::MATCH) out << ", shape=doublecircle color=green";
+        else if (s.type == StateType::MATCH) out << ", shape=doublecircle color=green";
         else out << ", shape=circle";
 
         out << "];\n";
 
         // Edges
-        if (s->out) {
-            out << "  \"" << s << "\" -> \"" << s->out << "\"";
-            std::string lbl = edge_label(s);
+        if (s.out != NO_STATE) {
+            out << "  \"s" << id << "\" -> \"s" << s.out << "\"";
+            std::string lbl = edge_label(prog, s);
             if (!lbl.empty())
                 out << " [label=\"" << lbl << "\"]";
             out << ";\n";
         }
 
-        if (s->out1) {
-            out << "  \"" << s << "\" -> \"" << s->out1 << "\" [label=\"ε\"];\n";
+        if (s.out1 != NO_STATE) {
+            out << "  \"s" << id << "\" -> \"s" << s.out1 << "\" [label=\"ε\"];\n";
         }
 
-        print_state(s->out, false, visited, out);
-        print_state(s->out1, false, visited, out);
+        print_state(prog, s.out, false, visited, out);
+        print_state(prog, s.out1, false, visited, out);
     }
 
-    static std::string state_label(State* s) {
-        switch (s->type) {
+    static std::string state_label(const State& s) {
+        switch (s.type) {
             case StateType::CHAR:
                 return "CHAR";
             case StateType::DOT:
@@ -112,26 +190,32 @@ private:
             case StateType::MATCH:
                 return "MATCH";
             case StateType::SAVE:
-                return "SAVE " + std::to_string(s->save_id) +
-                       (s->save_id % 2 == 0 ? " (start)" : " (end)");
+                return "SAVE " + std::to_string(s.save_id) +
+                       (s.save_id % 2 == 0 ? " (start)" : " (end)");
             case StateType::ANCHOR_START:
                 return "ANCHOR ^";
             case StateType::ANCHOR_END:
                 return "ANCHOR $";
+            case StateType::REPEAT:
+                return "REPEAT " + std::to_string(s.counter);
+            case StateType::NEXT:
+                return "NEXT " + std::to_string(s.counter);
             default:
                 return "UNKNOWN";
         }
     }
 
-    static std::string edge_label(State* s) {
+    static std::string edge_label(const Program& prog, const State& s) {
         std::string str = "";
-        switch (s->type) {
+        switch (s.type) {
             case StateType::CHAR:
-                str += dot_escape_char(s->c);
+                str += dot_escape_char(s.c);
                 break;
             case StateType::CHAR_CLASS: {
-                str = s->negated ? "[^" : "[";
-                for (auto& r : s->ranges) {
+                str = s.negated ? "[^" : "[";
+                const ClassRef& cr = prog.classes[s.cls];
+                for (uint32_t k = cr.first; k < cr.first + cr.count; k++) {
+                    const CharRange& r = prog.ranges[k];
                     str += dot_escape_char(r.lo);
                     if (r.lo != r.hi) {
                         str += "-";
@@ -145,6 +229,8 @@ private:
             case StateType::SAVE:
             case StateType::ANCHOR_START:
             case StateType::ANCHOR_END:
+            case StateType::REPEAT:
+            case StateType::NEXT:
                 str += "ε";
                 break;
             default:
@@ -0,0 +1,530 @@
+#include "nfa_optimizer.hpp"
+
+namespace {
+
+// Bits of NfaOptimizer::marks
+constexpr uint8_t REACHED = 1;  // reachable from the start
+constexpr uint8_t FRESH = 2;    // reachable from the start without consuming
+constexpr uint8_t ENDS = 4;     // reaches a MATCH without consuming
+constexpr uint8_t LIVE = 8;     // reaches a MATCH through states that can be passed
+constexpr uint8_t QUEUED = 16;  // on the work list of merge_equivalent()
+
+// Bits of NfaOptimizer::cyclic
+constexpr uint8_t CYCLE = 1;    // on a cycle of epsilon transitions
+constexpr uint8_t OPEN = 2;     // on Tarjan's stack
+
+// States a SPLIT tree may be walked through before collapsing it is given
+// up; keeps the pass linear
+constexpr size_t MAX_COLLAPSE_VISITS = 64;
+
+bool is_epsilon(StateType t){
+    return t == StateType::SPLIT || t == StateType::SAVE || t == StateType::ANCHOR_START || t == StateType::ANCHOR_END ||
+           t == StateType::REPEAT || t == StateType::NEXT;
+}
+
+}  // namespace
+
+void NfaOptimizer::optimize(Program &p, size_t groups){
+    if (p.start == NO_STATE) return;
+    prog = &p;
+    changed = false;
+    jumps = false;
+    cycles_found = false;
+    drop_captures(groups);
+    cut_dead();
+    collapse_splits();
+    skip_jumps();
+    merge_equivalent();
+    skip_jumps();
+    compact();
+}
+
+// A SPLIT with one way out, or twice the same one
+StateId NfaOptimizer::jump_target(const State &s){
+    if (s.type != StateType::SPLIT) return NO_STATE;
+    if (s.out1 == NO_STATE || s.out1 == s.out) return s.out;
+    if (s.out == NO_STATE) return s.out1;
+    return NO_STATE;
+}
+
+// Counting sort of the transitions by target
+void NfaOptimizer::find_predecessors(){
+    const std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    first.assign(n + 1, 0);
+    for (const State &s : states){
+        if (s.out != NO_STATE) first[s.out]++;
+        if (s.out1 != NO_STATE) first[s.out1]++;
+    }
+    uint32_t total = 0;
+    for (size_t i = 0; i < n; i++){
+        total += first[i];
+        first[i] = total;
+    }
+    first[n] = total;
+    pred.resize(total);
+    for (StateId id = 0; id < n; id++){
+        if (states[id].out != NO_STATE) pred[--first[states[id].out]] = id;
+        if (states[id].out1 != NO_STATE) pred[--first[states[id].out1]] = id;
+    }
+}
+
+bool NfaOptimizer::on_epsilon_cycle(StateId id){
+    if (!cycles_found){
+        find_epsilon_cycles();
+        cycles_found = true;
+    }
+    return cyclic[id] & CYCLE;
+}
+
+// A state is on a cycle if its component has more than one state or it
+// leads to itself. Only epsilon transitions between epsilon states count.
+void NfaOptimizer::find_epsilon_cycles(){
+    const std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    cyclic.assign(n, 0);
+    order.assign(n, 0);     // 0 until visited, then the visit number
+    low.resize(n);
+    uint32_t visits = 0;
+    auto visit = [&](StateId id){
+        order[id] = low[id] = ++visits;
+        cyclic[id] |= OPEN;
+        open.push_back(id);
+        frames.push_back({id, 0});
+    };
+
+    for (StateId root = 0; root < n; root++){
+        if (order[root] != 0 || !is_epsilon(states[root].type)) continue;
+        visit(root);
+        while (!frames.empty()){
+            auto &[id, edge] = frames.back();
+            if (edge < 2){
+                StateId next = edge++ == 0 ? states[id].out : states[id].out1;
+                if (next == NO_STATE || !is_epsilon(states[next].type)) continue;
+                if (next == id) cyclic[id] |= CYCLE;
+                else if (order[next] == 0) visit(next);
+                else if (cyclic[next] & OPEN) low[id] = std::min(low[id], order[next]);
+                continue;
+            }
+            StateId done = id;
+            frames.pop_back();
+            if (!frames.empty()) low[frames.back().first] = std::min(low[frames.back().first], low[done]);
+            if (low[done] != order[done]) continue;
+            // 'done' is the first state of its component, which is the top of 'open' down to it
+            bool cycle = open.back() != done;
+            StateId member;
+            do{
+                member = open.back();
+                open.pop_back();
+                cyclic[member] = static_cast<uint8_t>((cyclic[member] & ~OPEN) | (cycle ? CYCLE : 0));
+            }while (member != done);
+        }
+    }
+}
+
+// A dropped SAVE becomes a jump to where it led
+void NfaOptimizer::drop_captures(size_t groups){
+    if (groups >= prog->num_slots / 2) return;
+    const size_t kept = std::max<size_t>(groups, 1) * 2;
+    for (State &s : prog->states){
+        if (s.type == StateType::SAVE && static_cast<size_t>(s.save_id) >= kept){
+            s.type = StateType::SPLIT;
+            s.save_id = -1;
+            s.out1 = NO_STATE;
+            jumps = true;
+        }
+    }
+    prog->num_slots = kept;
+}
+
+// A state is live if a MATCH can be reached from it through states that can
+// all be passed. '^' only holds before the first byte, so it is live only if
+// the start reaches it without consuming anything; '$' only holds after the
+// last one, so it is live only if it reaches a MATCH without consuming
+// anything. Branches of a SPLIT into dead states are cut, which leaves every
+// dead state unreachable. A program that can never match is left as it is.
+// Every state NfaBuilder creates can reach the exits of its fragment, so
+// without anchors or empty classes there is nothing to cut.
+void NfaOptimizer::cut_dead(){
+    std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    bool blocked = false;
+    for (const State &s : states){
+        blocked |= s.type == StateType::ANCHOR_START || s.type == StateType::ANCHOR_END ||
+                   (s.type == StateType::CHAR_CLASS && !s.negated && prog->classes[s.cls].count == 0);
+    }
+    if (!blocked) return;
+    find_predecessors();
+    marks.assign(n, 0);
+
+    // Forward from the start, along every transition or only epsilon ones
+    auto forward = [&](uint8_t mark, bool epsilon_only){
+        stack.assign(1, prog->start);
+        while (!stack.empty()){
+            StateId id = stack.back();
+            stack.pop_back();
+            if (id == NO_STATE || (marks[id] & mark)) continue;
+            marks[id] |= mark;
+            if (epsilon_only && !is_epsilon(states[id].type)) continue;
+            stack.push_back(states[id].out);
+            stack.push_back(states[id].out1);
+        }
+    };
+    // Backwards from the MATCH states, to the predecessors 'admit' accepts
+    auto backward = [&](uint8_t mark, auto admit){
+        stack.clear();
+        for (StateId id = 0; id < n; id++){
+            if (states[id].type == StateType::MATCH && (marks[id] & REACHED)) stack.push_back(id);
+        }
+        while (!stack.empty()){
+            StateId id = stack.back();
+            stack.pop_back();
+            if (marks[id] & mark) continue;
+            marks[id] |= mark;
+            for (uint32_t k = first[id]; k < first[id + 1]; k++){
+                if (admit(pred[k])) stack.push_back(pred[k]);
+            }
+        }
+    };
+
+    forward(REACHED, false);
+    forward(FRESH, true);
+    backward(ENDS, [&](StateId id){ return is_epsilon(states[id].type); });
+    backward(LIVE, [&](StateId id){
+        const State &s = states[id];
+        if (!(marks[id] & REACHED)) return false;
+        switch (s.type){
+        case StateType::ANCHOR_START:
+            return (marks[id] & FRESH) != 0;
+        case StateType::ANCHOR_END:
+            return (marks[id] & ENDS) != 0;
+        case StateType::CHAR_CLASS:
+            return s.negated || prog->classes[s.cls].count > 0;
+        default:
+            return true;
+        }
+    });
+
+    if (!(marks[prog->start] & LIVE)) return;
+    for (StateId id = 0; id < n; id++){
+        State &s = states[id];
+        if (!(marks[id] & LIVE) || s.type != StateType::SPLIT) continue;
+        for (StateId *branch : {&s.out, &s.out1}){
+            if (*branch != NO_STATE && !(marks[*branch] & LIVE)){
+                *branch = NO_STATE;
+                changed = jumps = true;
+            }
+        }
+    }
+}
+
+// The engines follow a SPLIT depth first, 'out' before 'out1', skipping
+// states already visited, so what a SPLIT contributes is the ordered list of
+// non-SPLIT states its closure reaches. With at most two of them the SPLIT is
+// wired to them directly; the list is the same, so are the priorities, and
+// other SPLITs walking through this one see the same list too. A SPLIT
+// between two states that are not SPLITs is as collapsed as it gets.
+// A walk that meets a SPLIT on a cycle of epsilon transitions gives up: an
+// engine expanding a state of the list could come back to that SPLIT while
+// it is still being walked and stop there, which it no longer would once
+// the SPLIT is out of the way. ((^)*|$)a is one: with '$' cut, the outer
+// SPLIT would become a second entry into the loop.
+void NfaOptimizer::collapse_splits(){
+    std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    uint32_t stamp = 0;
+
+    for (StateId id = 0; id < n; id++){
+        const State &split = states[id];
+        if (split.type != StateType::SPLIT) continue;
+        if (split.out != NO_STATE && split.out1 != NO_STATE && split.out != split.out1 &&
+            states[split.out].type != StateType::SPLIT && states[split.out1].type != StateType::SPLIT){
+            continue;
+        }
+        if (stamp++ == 0) stamps.assign(n, 0);
+        StateId found[2];
+        size_t count = 0, visits = 0;
+        bool gave_up = false;
+        stack.assign(1, id);
+        while (!stack.empty() && !gave_up){
+            StateId s = stack.back();
+            stack.pop_back();
+            if (s == NO_STATE || stamps[s] == stamp) continue;
+            stamps[s] = stamp;
+            const State &curr = states[s];
+            if (curr.type == StateType::SPLIT){
+                if (on_epsilon_cycle(s)){
+                    gave_up = true;
+                    break;
+                }
+                stack.push_back(curr.out1);
+                stack.push_back(curr.out);
+                gave_up = ++visits > MAX_COLLAPSE_VISITS;
+            }else if (count < 2){
+                found[count++] = s;
+            }else{
+                gave_up = true;
+            }
+        }
+        if (gave_up || count == 0){
+            jumps |= jump_target(states[id]) != NO_STATE;
+            continue;
+        }
+        states[id].out = found[0];
+        states[id].out1 = (count == 2) ? found[1] : NO_STATE;
+        changed = true;
+        jumps |= count == 1;
+    }
+}
+
+// Every transition and the start go past the jumps they lead to. After
+// collapse_splits() a jump leads to a state that is not a SPLIT, so this is
+// mostly one step; the bound only guards against a loop of jumps.
+void NfaOptimizer::skip_jumps(){
+    if (!jumps) return;
+    jumps = false;
+    changed = true;
+    std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    auto resolve = [&](StateId t){
+        for (size_t hops = 0; t != NO_STATE && hops < n; hops++){
+            StateId next = jump_target(states[t]);
+            if (next == NO_STATE) break;
+            t = next;
+        }
+        return t;
+    };
+    for (State &s : states){
+        s.out = resolve(s.out);
+        s.out1 = resolve(s.out1);
+    }
+    prog->start = resolve(prog->start);
+}
+
+// Two states that do the same thing and lead to the same states are
+// interchangeable: whichever of them an engine visits first, the other one
+// would only repeat it with a lower priority. That takes the first one to be
+// done with by the time the other is visited, which does not hold for
+// epsilon states on a cycle, so those are not merged. States are hashed by
+// what they do and where they lead; merging a state changes the successors
+// of its predecessors, so those are hashed again, which shares common tails
+// of any length. The table holds state indices and compares their current
+// keys, so an entry whose successors were merged since simply stops
+// matching.
+void NfaOptimizer::merge_equivalent(){
+    std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+
+    // Two states with the same key lead to the same 'out' and the same
+    // 'out1', so a state that is the only one to lead where it does is not
+    // hashed at all. That is most states (all of a{1000}, the SPLITs of
+    // .{0,100}); merging raises the counts and hands the states concerned
+    // back to the work list.
+    in_out.assign(n, 0);
+    in_out1.assign(n, 0);
+    for (const State &s : states){
+        if (s.out != NO_STATE) in_out[s.out]++;
+        if (s.out1 != NO_STATE) in_out1[s.out1]++;
+    }
+    stack.clear();
+    for (StateId id = static_cast<StateId>(n); id-- > 0;){
+        const State &s = states[id];
+        if (s.out != NO_STATE && in_out[s.out] >= 2 && (s.out1 == NO_STATE || in_out1[s.out1] >= 2) &&
+            !(is_epsilon(s.type) && on_epsilon_cycle(id))){
+            stack.push_back(id);
+        }
+    }
+    if (stack.empty()) return;
+
+    find_predecessors();
+    marks.assign(n, 0);
+    for (StateId id : stack) marks[id] |= QUEUED;
+    rep.resize(n);
+    for (StateId id = 0; id < n; id++) rep[id] = id;
+    auto find = [&](StateId id){
+        if (id == NO_STATE) return id;
+        while (rep[id] != id){
+            rep[id] = rep[rep[id]];
+            id = rep[id];
+        }
+        return id;
+    };
+    auto worth_hashing = [&](StateId id){
+        StateId out = find(states[id].out), out1 = find(states[id].out1);
+        return out != NO_STATE && in_out[out] >= 2 && (out1 == NO_STATE || in_out1[out1] >= 2) &&
+               !(is_epsilon(states[id].type) && on_epsilon_cycle(id));
+    };
+    auto requeue_predecessors = [&](StateId id){
+        for (uint32_t p = first[id]; p < first[id + 1]; p++){
+            StateId q = pred[p];
+            if (rep[q] == q && !(marks[q] & QUEUED)){
+                marks[q] |= QUEUED;
+                stack.push_back(q);
+            }
+        }
+    };
+
+    // What a state does (type and payload) and where it leads
+    struct Key {
+        uint64_t what;
+        uint64_t where;
+        bool operator==(const Key &) const = default;
+    };
+    auto key_of = [&](StateId id){
+        const State &s = states[id];
+        uint64_t payload = 0;
+        switch (s.type){
+        case StateType::CHAR:
+            payload = static_cast<unsigned char>(s.c);
+            break;
+        case StateType::CHAR_CLASS:
+            payload = (uint64_t(s.cls) << 1) | (s.negated ? 1 : 0);
+            break;
+        case StateType::SAVE:
+            payload = static_cast<uint32_t>(s.save_id);
+            break;
+        case StateType::MATCH:
+            payload = s.pattern;
+            break;
+        case StateType::REPEAT:
+        case StateType::NEXT:
+            payload = s.counter;
+            break;
+        default:
+            break;
+        }
+        return Key{(payload << 8) | static_cast<uint64_t>(s.type), (uint64_t(find(s.out)) << 32) | find(s.out1)};
+    };
+    auto hash = [](const Key &k){
+        uint64_t h = (k.what * 0x9E3779B97F4A7C15ULL) ^ k.where;
+        h = (h ^ (h >> 31)) * 0xC2B2AE3D27D4EB4FULL;
+        return static_cast<size_t>(h ^ (h >> 32));
+    };
+
+    // Linear probing, kept at most 3/4 full; growing drops the entries of
+    // states merged since they were inserted
+    size_t size = 16, entries = 0;
+    while (size < 2 * stack.size()) size <<= 1;
+    table.assign(size, NO_STATE);
+    auto grow = [&](){
+        std::vector<StateId> old(size * 2, NO_STATE);
+        old.swap(table);
+        size *= 2;
+        entries = 0;
+        for (StateId id : old){
+            if (id == NO_STATE || rep[id] != id) continue;
+            size_t slot = hash(key_of(id));
+            while (table[slot & (size - 1)] != NO_STATE) slot++;
+            table[slot & (size - 1)] = id;
+            entries++;
+        }
+    };
+
+    bool merged = false;
+    while (!stack.empty()){
+        StateId id = stack.back();
+        stack.pop_back();
+        marks[id] &= static_cast<uint8_t>(~QUEUED);
+        if (rep[id] != id || !worth_hashing(id)) continue;
+        if (4 * (entries + 1) > 3 * size) grow();
+        Key k = key_of(id);
+        StateId other = NO_STATE;
+        for (size_t slot = hash(k);; slot++){
+            StateId &entry = table[slot & (size - 1)];
+            if (entry == NO_STATE){
+                entry = id;
+                entries++;
+                break;
+            }
+            StateId known = find(entry);
+            if (known == id) break;
+            if (key_of(known) == k){
+                other = known;
+                break;
+            }
+        }
+        if (other == NO_STATE) continue;
+        rep[id] = other;
+        merged = true;
+        bool was_single = in_out[other] < 2 || in_out1[other] < 2;
+        in_out[other] += in_out[id];
+        in_out1[other] += in_out1[id];
+        requeue_predecessors(id);
+        if (was_single) requeue_predecessors(other);
+    }
+
+    if (!merged) return;
+    for (State &s : states){
+        s.out = find(s.out);
+        s.out1 = find(s.out1);
+    }
+    prog->start = find(prog->start);
+    changed = jumps = true;
+}
+
+// States keep their relative order, so the program reads as it was built.
+// NfaBuilder leaves no unreachable state behind, so an untouched program is
+// left as it is.
+void NfaOptimizer::compact(){
+    if (!changed) return;
+    std::vector<State> &states = prog->states;
+    const size_t n = states.size();
+    std::vector<StateId> &renamed = rep;
+    renamed.assign(n, NO_STATE);
+    stack.assign(1, prog->start);
+    while (!stack.empty()){
+        StateId id = stack.back();
+        stack.pop_back();
+        if (id == NO_STATE || renamed[id] != NO_STATE) continue;
+        renamed[id] = 0;
+        stack.push_back(states[id].out);
+        stack.push_back(states[id].out1);
+    }
+
+    StateId kept = 0;
+    for (StateId id = 0; id < n; id++){
+        if (renamed[id] != NO_STATE) renamed[id] = kept++;
+    }
+    if (kept == n) return;
+    auto rename = [&](StateId t){ return t == NO_STATE ? t : renamed[t]; };
+    for (StateId id = 0; id < n; id++){
+        if (renamed[id] == NO_STATE) continue;
+        State s = states[id];
+        s.out = rename(s.out);
+        s.out1 = rename(s.out1);
+        states[renamed[id]] = s;
+    }
+    states.erase(states.begin() + kept, states.end());
+    prog->start = renamed[prog->start];
+}
+
+// Time Complexity Analysis:
+
+// S = number of states, E = number of transitions (at most 2S)
+
+// drop_captures(), skip_jumps(), compact():
+// One pass over the states → O(S); a jump left by collapse_splits() leads to
+// a state that is not a jump, so resolving a transition is O(1)
+
+// cut_dead():
+// Four graph searches (reachable, reachable without consuming, reaching a
+// MATCH without consuming, live) over the states and the predecessor table
+// → O(S + E)
+
+// find_epsilon_cycles():
+// Tarjan's algorithm, iterative: every state and epsilon transition once →
+// O(S + E), at most once per optimize() and only if a SPLIT tree or an
+// epsilon state has to be checked
+
+// collapse_splits():
+// At most MAX_COLLAPSE_VISITS SPLITs walked per SPLIT → O(S)
+
+// merge_equivalent():
+// Counting the predecessors is O(S). Only states that share both successors
+// with another state are hashed, once, plus once more each time one of their
+// successors is merged; a state is merged at most once, so there are at most
+// E extra hashes → O(S + E) expected
+
+// optimize():
+// Total TC = O(S) expected. The side tables (a few bytes per state) are
+// allocated by the first call and reused by the next ones.
@@ -0,0 +1,78 @@
+#ifndef NFA_OPTIMIZER_HPP
+#define NFA_OPTIMIZER_HPP
+#include "nfa.hpp"
+
+// Shrinks a program built by NfaBuilder without changing what it matches:
+// the same matches, found with the same leftmost-first priorities, and the
+// same captures for every group that is kept. The passes run in this order:
+//
+// - the SAVE states of groups the caller does not want become plain jumps
+// - dead states are cut: states from which no MATCH can be reached, '^' once
+//   a byte has been consumed, '$' with a byte still to consume, and classes
+//   that accept no byte
+// - SPLIT trees are collapsed: a SPLIT whose epsilon closure holds at most
+//   two states that are not SPLITs is wired straight to them, in priority
+//   order, so the two SPLITs of (a?)? become one
+// - jumps (SPLITs left with a single way out) are stepped over
+// - states of the same kind with the same successors are merged, e.g. the
+//   common tail of ab|cb
+// - states no longer reachable from the start are dropped and the others
+//   renumbered in their original order
+//
+// States on a cycle of epsilon transitions (the loop of x* when x can match
+// the empty string) are neither collapsed nor merged. The engines cut such a
+// loop where it first comes back to a state they are still expanding, and
+// which threads survive depends on where that cut falls.
+//
+// Fewer states shorten the Pike VM's thread lists and the backtracker's
+// visited bitset, and give the DFAs smaller state sets to hash.
+class NfaOptimizer
+{
+public:
+    static constexpr size_t ALL_GROUPS = std::numeric_limits<size_t>::max();
+
+    // Keeps the captures of groups 0 .. groups - 1 (group 0, the whole match,
+    // needs no SAVE state). The side tables are kept for the next call.
+    void optimize(Program &prog, size_t groups = ALL_GROUPS);
+
+private:
+    void drop_captures(size_t groups);
+    void cut_dead();
+    void collapse_splits();
+    void skip_jumps();
+    void merge_equivalent();
+    void compact();
+
+    // The single way out of a jump, NO_STATE if 's' is not one
+    static StateId jump_target(const State &s);
+
+    // Predecessors of every state: pred[first[t] .. first[t + 1]) lead to 't'
+    void find_predecessors();
+
+    // True if 'id' can come back to itself without consuming; worked out for
+    // all states on the first call of each optimize()
+    bool on_epsilon_cycle(StateId id);
+    void find_epsilon_cycles();
+
+    Program *prog = nullptr;
+    bool changed = false;   // a transition was rewired, so some states may be unreachable
+    bool jumps = false;     // a SPLIT may have been left with a single way out
+    bool cycles_found = false;  // 'cyclic' describes the program
+    std::vector<uint8_t> marks;     // per state, see nfa_optimizer.cpp
+    std::vector<uint32_t> first;
+    std::vector<StateId> pred;
+    std::vector<uint32_t> stamps;   // collapse_splits(): last SPLIT whose walk saw the state
+    std::vector<uint32_t> in_out;   // merge_equivalent(): transitions into the state through 'out'
+    std::vector<uint32_t> in_out1;  // ... and through 'out1'
+    std::vector<StateId> rep;       // merge_equivalent(): the state each one was merged into
+    std::vector<StateId> table;     // merge_equivalent(): open-addressing hash table of states
+    std::vector<StateId> stack;
+
+    // find_epsilon_cycles(): Tarjan's strongly connected components
+    std::vector<uint8_t> cyclic;
+    std::vector<uint32_t> order, low;
+    std::vector<std::pair<StateId, int>> frames;
+    std::vector<StateId> open;
+};
+
+#endif  // NFA_OPTIMIZER_HPP
@@ -0,0 +1,170 @@
+#include "onepass.hpp"
+#include <bit>
+
+// Builds one DFA state per root (the start of the program, or the target of a
+// consuming state) and fills its row by walking the root's epsilon closure
+// depth first, in priority order, remembering the registers written along
+// the way. The program is not one-pass as soon as a state is reached twice,
+// MATCH is reached twice, or two consuming states accept the same byte class.
+// A DFA state has no count to follow a counted loop with, so a program with
+// counters is never taken.
+std::unique_ptr<OnePass> OnePass::compile(const Program &prog, size_t max_bytes){
+    if (prog.num_slots > MAX_SLOTS || !prog.counters.empty()) return nullptr;
+
+    std::unique_ptr<OnePass> op(new OnePass());
+    op->classes = prog.byte_classes.map;
+    op->stride = prog.byte_classes.count;
+    op->num_slots = prog.num_slots;
+    op->prefilter = prog.prefilter;
+    const std::vector<unsigned char> reps = prog.byte_classes.representatives();
+
+    // The start state is kept apart from the other states of the same root:
+    // it is the only one where ^ holds
+    std::vector<uint32_t> ids(prog.size(), DEAD);   // root -> DFA state
+    std::vector<StateId> roots(1, NO_STATE);        // DFA state -> root
+    op->table.resize(op->stride);
+    op->matches.resize(1);
+    auto add = [&](StateId root){
+        roots.push_back(root);
+        op->table.resize(op->table.size() + op->stride);
+        op->matches.emplace_back();
+        return static_cast<uint32_t>(roots.size() - 1);
+    };
+    op->start = add(prog.start);
+
+    struct Item {
+        StateId s;
+        uint32_t slots;     // registers written on the path
+        bool eof;           // passed a $: only MATCH can follow
+        bool anchored;      // passed a ^
+    };
+    std::vector<Item> stack;
+    std::vector<uint32_t> seen(prog.size(), 0);
+    bool anchored = true;
+
+    for (uint32_t d = 1; d < roots.size(); d++){
+        if (op->table.size() * sizeof(Trans) > max_bytes) return nullptr;
+        const bool at_start = d == op->start;
+        bool match_seen = false;
+        stack.push_back({roots[d], 0, false, false});
+        while (!stack.empty()){
+            Item it = stack.back();
+            stack.pop_back();
+            if (it.s == NO_STATE) continue;
+            if (seen[it.s] == d) return nullptr;
+            seen[it.s] = d;
+
+            const State &curr = prog[it.s];
+            switch (curr.type){
+            case StateType::SPLIT:
+                stack.push_back({curr.out1, it.slots, it.eof, it.anchored});
+                stack.push_back({curr.out, it.slots, it.eof, it.anchored});
+                break;
+            case StateType::SAVE:
+                if (curr.save_id >= 2) it.slots |= uint32_t(1) << (curr.save_id - 2);
+                stack.push_back({curr.out, it.slots, it.eof, it.anchored});
+                break;
+            case StateType::ANCHOR_START:
+                if (at_start) stack.push_back({curr.out, it.slots, it.eof, true});
+                break;
+            case StateType::ANCHOR_END:
+                stack.push_back({curr.out, it.slots, true, it.anchored});
+                break;
+            case StateType::MATCH:
+            {
+                MatchInfo &m = op->matches[d];
+                if (m.kind != Accept::NONE) return nullptr;
+                m = {it.eof ? Accept::AT_EOF : Accept::ANY, it.slots};
+                match_seen = match_seen || !it.eof;
+                if (at_start && !it.anchored) anchored = false;
+                break;
+            }
+            default:    // CHAR, DOT, CHAR_CLASS
+            {
+                if (it.eof) break;
+                if (at_start && !it.anchored) anchored = false;
+                uint32_t next = ids[curr.out];
+                if (next == DEAD) next = ids[curr.out] = add(curr.out);
+                Trans *row = &op->table[d * op->stride];
+                for (size_t k = 0; k < op->stride; k++){
+                    if (!prog.accepts(curr, static_cast<char>(reps[k]))) continue;
+                    if (row[k].next != DEAD) return nullptr;
+                    row[k] = {next, it.slots | (match_seen ? AFTER_MATCH : 0)};
+                }
+                break;
+            }
+            }
+        }
+    }
+    op->anchored = anchored;
+    return op;
+}
+
+bool OnePass::match(std::string_view input, Captures *caps) const{
+    Captures local;
+    return run(input, true, caps ? *caps : local);
+}
+
+bool OnePass::search(std::string_view input, Captures *caps) const{
+    if (!anchored) throw std::runtime_error("one-pass search needs a pattern anchored at the start");
+    Captures local;
+    return run(input, false, caps ? *caps : local);
+}
+
+void OnePass::apply(size_t *r, uint32_t slots, size_t pos){
+    for (slots &= ~AFTER_MATCH; slots; slots &= slots - 1) r[2 + static_cast<size_t>(std::countr_zero(slots))] = pos;
+}
+
+// full = true: the match must end at the end of the input. Otherwise the
+// scan remembers the last match seen and stops once no thread of a higher
+// priority is left, like the Pike VM does.
+// 'out' doubles as scratch: the live registers are its first half and the
+// registers of the last match seen its second half, so the DFA itself stays
+// read-only and the caller's vector is the only memory used.
+bool OnePass::run(std::string_view input, bool full, Captures &out) const{
+    if (!prefilter.may_match(input)) return false;
+    out.assign(2 * num_slots, NO_POS);
+    size_t *regs = out.data();
+    size_t *best = out.data() + num_slots;
+    regs[0] = 0;
+    bool matched = false;
+
+    uint32_t s = start;
+    size_t i = 0;
+    for (; i < input.size(); i++){
+        const MatchInfo &m = matches[s];
+        if (!full && m.kind == Accept::ANY){
+            std::copy(regs, regs + num_slots, best);
+            apply(best, m.slots, i);
+            best[1] = i;
+            matched = true;
+        }
+        const Trans &t = table[s * stride + classes[static_cast<unsigned char>(input[i])]];
+        if (t.next == DEAD || (!full && (t.slots & AFTER_MATCH))) break;
+        apply(regs, t.slots, i);
+        s = t.next;
+    }
+
+    if (i == input.size() && matches[s].kind != Accept::NONE){
+        apply(regs, matches[s].slots, i);
+        regs[1] = i;
+        out.resize(num_slots);
+        return true;
+    }
+    if (matched) out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(num_slots));
+    else out.resize(num_slots);
+    return matched;
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states, k = number of byte classes,
+// r = number of capture registers
+
+// compile():
+// At most m DFA states; each closure visits every NFA state at most once and
+// every consuming state fills at most k transitions → O(m * (m + k))
+
+// match() / search():
+// One table lookup per byte plus the registers written → O(n * r) worst case,
+// O(n) for patterns whose transitions write no register
@@ -0,0 +1,76 @@
+#ifndef ONEPASS_HPP
+#define ONEPASS_HPP
+#include "nfa.hpp"
+#include "match.hpp"
+
+// One-pass DFA: resolves captures in a single forward scan, with no thread
+// list and no backtracking.
+// A program is one-pass when, starting at the beginning of the input, at most
+// one NFA thread can consume any given byte: from every state, the epsilon
+// closure reaches each byte class through at most one consuming state and
+// one path (e.g. ^(\d+)-(\d+)$ or key=value parsers). The path is then known
+// as soon as the byte is read, so each DFA transition carries the capture
+// registers (save_id slots) written along it, and matching is one table
+// lookup per byte plus those register writes.
+//
+// DFA states are the epsilon closures of single NFA states, so there are at
+// most as many as there are consuming states. Only anchored searches are
+// supported: match() always, search() when every match starts at position 0.
+class OnePass
+{
+public:
+    static constexpr size_t DEFAULT_MAX_BYTES = 1024 * 1024;
+    static constexpr size_t MAX_SLOTS = 2 + 31;  // group 0 plus 31 registers in a transition
+
+    // Returns nullptr if the program is not one-pass, uses more than
+    // MAX_SLOTS capture registers, or needs a table larger than 'max_bytes'
+    static std::unique_ptr<OnePass> compile(const Program &prog, size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // Same results as PikeVM::match. The DFA is only read, so any number of
+    // threads may match with it at once.
+    bool match(std::string_view input, Captures *caps = nullptr) const;
+
+    // Same results as PikeVM::search; only valid if is_anchored()
+    bool search(std::string_view input, Captures *caps = nullptr) const;
+
+    // True if every match starts at position 0 (the pattern begins with ^)
+    bool is_anchored() const { return anchored; }
+
+    size_t num_states() const { return table.size() / stride; }
+    size_t memory_usage() const { return table.size() * sizeof(Trans) + matches.size() * sizeof(MatchInfo); }
+
+private:
+    OnePass() = default;
+
+    static constexpr uint32_t DEAD = 0;
+
+    // Transition: the next state and the registers to set to the current
+    // position before consuming the byte (bit k = slot k + 2). AFTER_MATCH
+    // marks transitions that have a lower priority than the state's match,
+    // which leftmost-first search must not take.
+    struct Trans {
+        uint32_t next = DEAD;
+        uint32_t slots = 0;
+    };
+    static constexpr uint32_t AFTER_MATCH = uint32_t(1) << 31;
+
+    enum class Accept : uint8_t { NONE, ANY, AT_EOF };
+    struct MatchInfo {
+        Accept kind = Accept::NONE;
+        uint32_t slots = 0;     // registers set on the way to MATCH
+    };
+
+    bool run(std::string_view input, bool full, Captures &regs) const;
+    static void apply(size_t *regs, uint32_t slots, size_t pos);
+
+    std::array<uint8_t, 256> classes{};
+    size_t stride = 1;
+    std::vector<Trans> table;       // 'stride' transitions per state; state 0 is dead
+    std::vector<MatchInfo> matches; // per state
+    uint32_t start = DEAD;
+    size_t num_slots = 2;
+    bool anchored = false;
+    Prefilter prefilter;
+};
+
+#endif  // ONEPASS_HPP
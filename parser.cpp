@@ -0,0 +1,148 @@
+#include "parser.hpp"
+
+Parser::Parser(std::string_view pattern, size_t max_nesting)
+    : lexer(pattern), max_depth(std::min(max_nesting, MAX_NESTING)){
+    // Patterns are mostly atoms with one operator each
+    ast.nodes.reserve(2 * pattern.size());
+    advance();
+}
+
+Ast Parser::parse(std::string_view pattern, size_t max_depth){
+    Parser p(pattern, max_depth);
+    // The empty pattern is the empty tree
+    if (p.next.type != TokenType::END) p.alternation();
+    return std::move(p.ast);
+}
+
+void Parser::advance(){
+    if (lexer.eof()){
+        next = Token{TokenType::END, lexer.position()};
+    }else{
+        next = lexer.next_token();
+    }
+}
+
+bool Parser::at_quantifier() const{
+    return next.type == TokenType::STAR || next.type == TokenType::PLUS || next.type == TokenType::QUESTION ||
+           next.type == TokenType::QUANTIFIER_RANGE;
+}
+
+void Parser::alternation(){
+    concatenation();
+    while (next.type == TokenType::ALTERNATION){
+        Token bar = std::move(next);
+        advance();
+        if (next.type == TokenType::END) throw std::runtime_error("Syntax Error: Trailing binary operator");
+        concatenation();
+        emit(bar);
+    }
+}
+
+// Stops at '|', ')' or the end; whatever else comes next starts an operand
+void Parser::concatenation(){
+    switch (next.type){
+    case TokenType::ALTERNATION:
+    case TokenType::END:
+        throw std::runtime_error("Syntax Error: Empty side in alternation |");
+    case TokenType::RPAREN:
+        throw std::runtime_error(ast.nodes.back().type == TokenType::LPAREN ? "Syntax Error: Empty parentheses ()"
+                                                                            : "Syntax Error: Empty side in alternation |");
+    default:
+        break;
+    }
+    repetition();
+    while (next.type != TokenType::ALTERNATION && next.type != TokenType::RPAREN && next.type != TokenType::END){
+        repetition();
+        emit(Token{TokenType::CONCAT, next.pos});
+    }
+}
+
+// At most one quantifier, and only after something that consumes input
+void Parser::repetition(){
+    if (at_quantifier()) throw std::runtime_error("Syntax Error: Quantifier follows invalid token");
+    bool anchor = next.type == TokenType::CARET || next.type == TokenType::DOLLAR;
+    atom();
+    if (!at_quantifier()) return;
+    if (anchor) throw std::runtime_error("Syntax Error: Quantifier follows invalid token");
+    emit(next);
+    advance();
+    if (at_quantifier()) throw std::runtime_error("Syntax Error: Quantifier follows invalid token");
+}
+
+void Parser::atom(){
+    if (next.type != TokenType::LPAREN){
+        emit(next);
+        advance();
+        return;
+    }
+
+    // The tokenizer numbers the groups and matches the parentheses
+    if (++depth > max_depth) throw CompileError(CompileError::Kind::DEPTH, depth, max_depth);
+    emit(next);
+    advance();
+    alternation();
+    if (next.type != TokenType::RPAREN) throw std::runtime_error("Syntax Error: Mismatched (");
+    emit(next);
+    advance();
+    depth--;
+}
+
+void Parser::emit(const Token &t){
+    AstNode n{t.type};
+    switch (t.type){
+    case TokenType::LITERAL:
+        n.literal = t.literal;
+        break;
+    case TokenType::CHAR_CLASS:
+        n.negated = t.negated;
+        n.cls = intern(t.ranges);
+        break;
+    case TokenType::LPAREN:
+    case TokenType::RPAREN:
+        n.group_id = t.group_id;
+        break;
+    case TokenType::QUANTIFIER_RANGE:
+        n.min = t.min;
+        n.max = t.max;
+        break;
+    default:
+        break;
+    }
+    ast.nodes.push_back(n);
+}
+
+// A hash collision between different classes only costs the sharing: the
+// second class is stored on its own
+uint32_t Parser::intern(const std::vector<CharRange> &ranges){
+    uint64_t h = 14695981039346656037ULL;
+    for (const CharRange &r : ranges){
+        h = (h ^ static_cast<unsigned char>(r.lo)) * 1099511628211ULL;
+        h = (h ^ static_cast<unsigned char>(r.hi)) * 1099511628211ULL;
+    }
+    auto [it, inserted] = interned.try_emplace(h, static_cast<uint32_t>(ast.classes.size()));
+    if (!inserted){
+        const ClassRef &known = ast.classes[it->second];
+        auto first = ast.ranges.begin() + known.first;
+        if (std::equal(first, first + known.count, ranges.begin(), ranges.end(),
+                       [](const CharRange &a, const CharRange &b){ return a.lo == b.lo && a.hi == b.hi; })){
+            return it->second;
+        }
+    }
+    ast.classes.push_back({static_cast<uint32_t>(ast.ranges.size()), static_cast<uint32_t>(ranges.size())});
+    ast.ranges.insert(ast.ranges.end(), ranges.begin(), ranges.end());
+    return static_cast<uint32_t>(ast.classes.size() - 1);
+}
+
+// Time Complexity Analysis:
+
+// p = pattern length, c = number of character classes
+
+// parse():
+// Each character is read once by the tokenizer and each token becomes at
+// most one node (plus one CONCAT node between operands) → O(p). Interning is
+// one hash per class, O(p) over all classes. The recursion is as deep as the
+// groups nest, at most MAX_NESTING.
+
+// Memory:
+// One vector of 20-byte nodes, the ranges of each distinct class once, and
+// one hash entry per distinct class.
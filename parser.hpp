@@ -0,0 +1,54 @@
+#ifndef PARSER_HPP
+#define PARSER_HPP
+#include "ast.hpp"
+#include "compile_limits.hpp"
+
+// Recursive-descent parser: reads the pattern once, pulling tokens from the
+// Tokenizer one at a time, and appends each node of the syntax tree as soon
+// as its subtrees are complete, which is postfix order. No token vector is
+// built, concatenation needs no tokens of its own and there is no operator
+// stack to convert afterwards.
+//
+//   alternation   := concatenation ('|' concatenation)*
+//   concatenation := repetition+
+//   repetition    := atom [quantifier]
+//   atom          := literal | '.' | class | '^' | '$' | '(' alternation ')'
+//
+// Operators associate to the left, as in PostfixConverter. Anchors are
+// ordinary atoms and concatenate on both sides: "a|b^c" is a|(b^c) and
+// "($abc)|ab" is ($abc)|(ab). Tokenizer::add_concat_tokens put no CONCAT
+// before '^' or after '$', so PostfixConverter gave patterns with an anchor
+// in the middle a different tree.
+class Parser
+{
+public:
+    // Bounds the recursion whatever the limit asked for
+    static constexpr size_t MAX_NESTING = 1000;
+
+    // Throws std::runtime_error on a syntax error and CompileError if groups
+    // nest deeper than 'max_depth'
+    static Ast parse(std::string_view pattern, size_t max_depth = CompileLimits{}.max_depth);
+
+private:
+    Parser(std::string_view pattern, size_t max_depth);
+
+    void advance();
+    bool at_quantifier() const;
+    void alternation();
+    void concatenation();
+    void repetition();
+    void atom();
+    void emit(const Token &t);
+    uint32_t intern(const std::vector<CharRange> &ranges);
+
+    Tokenizer lexer;
+    Token next;         // lookahead; END once the pattern is used up
+    size_t depth = 0;
+    size_t max_depth;
+    Ast ast;
+
+    // Hash of a class's ranges -> its index, to find repeated classes
+    std::unordered_map<uint64_t, uint32_t> interned;
+};
+
+#endif  // PARSER_HPP
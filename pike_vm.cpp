@@ -0,0 +1,172 @@
+#include "pike_vm.hpp"
+
+// Sizes the thread lists for the states, so that running the VM never
+// allocates unless threads reach counts past 0
+PikeVM::PikeVM(const Program &p) : prog(p), pairs(p), num_slots(p.num_slots){
+    if (pairs.size() > NO_STATE) throw std::runtime_error("too many counted states for the Pike VM");
+    size_t n = prog.size();
+    for (ThreadList *list : {&clist, &nlist}){
+        list->visited.resize(n);
+        list->threads.resize(n);
+        list->caps.resize(n * num_slots);
+    }
+    scratch.resize(num_slots);
+    stack.reserve(2 * n + 1);
+}
+
+bool PikeVM::match(std::string_view input, Captures *caps){
+    return run(input, true, caps);
+}
+
+bool PikeVM::search(std::string_view input, Captures *caps){
+    return run(input, false, caps);
+}
+
+// Marks the pair as reached and returns false if it already was. Room for
+// the pairs with a count is only made once a thread gets to them.
+bool PikeVM::visit(ThreadList &list, StateId s, uint32_t count){
+    size_t id = pairs(s, count);
+    if (id >= list.visited.capacity()){
+        list.visited.grow(std::min(pairs.size(), std::max(id + 1, 2 * list.visited.capacity())));
+    }
+    return list.visited.insert(static_cast<uint32_t>(id));
+}
+
+// Adds the thread at state 's' with 'count' (with registers taken from
+// 'scratch') to 'list', following every epsilon transition. Only consuming
+// states and MATCH end up on the list. Branches are explored depth first with
+// 'out' before 'out1', which keeps the list in priority order.
+void PikeVM::add_thread(ThreadList &list, StateId s, uint32_t count, size_t pos, std::string_view input){
+    stack.push_back({s, count, NO_POS, 0});
+    while (!stack.empty()){
+        Frame f = stack.back();
+        stack.pop_back();
+        if (f.slot != NO_POS){   // Restore a register saved by a SAVE state
+            scratch[f.slot] = f.old;
+            continue;
+        }
+
+        StateId id = f.s;
+        count = f.count;
+        while (id != NO_STATE && visit(list, id, count)){
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+                stack.push_back({curr.out1, count, NO_POS, 0});
+                id = curr.out;
+                break;
+            case StateType::SAVE:
+            {
+                size_t slot = static_cast<size_t>(curr.save_id);
+                stack.push_back({NO_STATE, 0, slot, scratch[slot]});
+                scratch[slot] = pos;
+                id = curr.out;
+                break;
+            }
+            case StateType::REPEAT:
+            {
+                // Into the body while the count allows, then out of the loop
+                const Counter &k = prog.counters[curr.counter];
+                bool again = k.max == -1 || count < static_cast<uint32_t>(k.max);
+                if (count >= static_cast<uint32_t>(k.min)){
+                    if (!again){
+                        id = curr.out1;
+                        count = 0;
+                        break;
+                    }
+                    stack.push_back({curr.out1, 0, NO_POS, 0});
+                }
+                id = curr.out;
+                break;
+            }
+            case StateType::NEXT:
+                count = std::min(count + 1, prog.counters[curr.counter].limit());
+                id = curr.out;
+                break;
+            case StateType::ANCHOR_START:
+                id = (pos == 0) ? curr.out : NO_STATE;
+                break;
+            case StateType::ANCHOR_END:
+                id = (pos == input.size()) ? curr.out : NO_STATE;
+                break;
+            default:    // CHAR, DOT, CHAR_CLASS, MATCH
+                if (list.size == list.threads.size()){
+                    list.threads.resize(2 * list.size);
+                    list.caps.resize(list.threads.size() * num_slots);
+                }
+                list.threads[list.size] = {id, count};
+                std::copy(scratch.begin(), scratch.end(), list.caps.begin() + static_cast<std::ptrdiff_t>(list.size * num_slots));
+                list.size++;
+                id = NO_STATE;
+                break;
+            }
+        }
+    }
+}
+
+// Runs all threads in lockstep over the input.
+// anchored = true: the match must span the whole input.
+// anchored = false: a new thread is started at every position until the first
+// match is found, and lower priority threads are cut once a thread matches.
+// The program's prefilter rejects input that lacks a required literal, and
+// while no thread is alive it skips to the next position where a match can
+// start.
+bool PikeVM::run(std::string_view input, bool anchored, Captures *caps){
+    if (!prog.prefilter.may_match(input)) return false;
+    bool matched = false;
+    bool skip = !anchored && prog.prefilter.is_active();
+    clist.size = 0;
+    clist.visited.clear();
+
+    for (size_t i = 0; i <= input.size(); i++){
+        if (skip && clist.size == 0 && !matched){
+            i = prog.prefilter.find(input, i);
+            if (i == std::string_view::npos) break;
+        }
+        if (!matched && (i == 0 || !anchored)){
+            std::fill(scratch.begin(), scratch.end(), NO_POS);
+            scratch[0] = i;
+            add_thread(clist, prog.start, 0, i, input);
+        }
+        if (clist.size == 0 && (matched || anchored)) break;
+
+        nlist.size = 0;
+        nlist.visited.clear();
+        for (size_t t = 0; t < clist.size; t++){
+            const Thread &thread = clist.threads[t];
+            const State &s = prog[thread.s];
+            size_t *regs = &clist.caps[t * num_slots];
+
+            if (s.type == StateType::MATCH){
+                if (anchored && i != input.size()) continue;
+                matched = true;
+                if (caps){
+                    caps->assign(regs, regs + num_slots);
+                    (*caps)[1] = i;
+                }
+                break;  // Threads after this one have lower priority
+            }
+            if (i < input.size() && prog.accepts(s, input[i])){
+                std::copy(regs, regs + num_slots, scratch.begin());
+                add_thread(nlist, s.out, thread.count, i + 1, input);
+            }
+        }
+        std::swap(clist, nlist);
+    }
+    return matched;
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states (of (state, count) pairs with
+// counted loops), k = number of capture registers
+
+// add_thread():
+// Every (state, count) pair enters the list's sparse set the first time it is
+// visited, so building one list visits each pair at most once → O(m) per
+// input position
+
+// run():
+// Each position walks the current list once and builds the next one → O(m * k)
+// Total TC = O(n * m * k), with no allocation after construction until threads
+// reach counts the lists have no room for yet
@@ -0,0 +1,72 @@
+#ifndef PIKE_VM_HPP
+#define PIKE_VM_HPP
+#include "nfa.hpp"
+#include "match.hpp"
+#include "sparse_set.hpp"
+
+// Thompson/Pike VM simulation of the NFA program produced by NfaBuilder.
+// All threads advance in lockstep over the input, so matching runs in
+// O(n * m) time (n = input length, m = number of states) with no backtracking.
+// Threads are kept in priority order, which gives leftmost-first (Perl-like)
+// match and submatch semantics.
+// Counted loops (see Counter) are followed: a thread in a loop carries its
+// count, and threads are told apart by state and count, so the VM runs as it
+// would over the expanded program, with m the number of (state, count) pairs
+// it reaches (see CountedStates). Its lists grow to hold them as needed.
+//
+// The program is only read; it must outlive the VM.
+class PikeVM
+{
+public:
+    explicit PikeVM(const Program &prog);
+
+    // True if the whole input matches the pattern
+    bool match(std::string_view input, Captures *caps = nullptr);
+
+    // True if some substring of the input matches; 'caps' receives the
+    // leftmost-first match and its groups
+    bool search(std::string_view input, Captures *caps = nullptr);
+
+    // Number of capture groups, including the implicit group 0
+    size_t num_groups() const { return num_slots / 2; }
+
+private:
+    struct Thread {
+        StateId s;
+        uint32_t count;     // passes through the loop 's' is in, if any
+    };
+
+    // A list of active threads; every thread owns 'num_slots' capture registers.
+    // 'visited' holds every (state, count) pair reached while building the
+    // list (epsilon states included), 'threads' only the consuming states and
+    // MATCH.
+    struct ThreadList {
+        SparseSet visited;
+        std::vector<Thread> threads;
+        std::vector<size_t> caps;
+        size_t size = 0;
+    };
+
+    // Pending work of the epsilon closure: either a state to explore or a
+    // capture register to restore once a branch has been fully explored
+    struct Frame {
+        StateId s;
+        uint32_t count;
+        size_t slot;
+        size_t old;
+    };
+
+    bool run(std::string_view input, bool anchored, Captures *caps);
+    void add_thread(ThreadList &list, StateId s, uint32_t count, size_t pos, std::string_view input);
+    bool visit(ThreadList &list, StateId s, uint32_t count);
+
+    const Program &prog;
+    const CountedStates pairs;
+    size_t num_slots;
+
+    ThreadList clist, nlist;
+    std::vector<size_t> scratch;    // registers of the thread being expanded
+    std::vector<Frame> stack;
+};
+
+#endif  // PIKE_VM_HPP
@@ -0,0 +1,393 @@
+#include "prefilter.hpp"
+#include "nfa.hpp"
+#include <bit>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PREFILTER_SSE2 1
+#endif
+
+namespace {
+
+// Epsilon closures over the program, in the style of the DFA's subset
+// construction, that also record how the walk ended
+struct Walker {
+    const Program &prog;
+    std::vector<uint32_t> visited;
+    uint32_t stamp = 0;
+    std::vector<StateId> stack;
+    bool saw_start_anchor = false;  // a '^' was reached at the start of input
+    bool can_end = false;           // a MATCH or '$' was reached
+
+    explicit Walker(const Program &p) : prog(p), visited(p.size(), 0) {}
+
+    void reset(){
+        stamp++;
+        saw_start_anchor = can_end = false;
+    }
+
+    // Adds every consuming state reachable from 's' through epsilon
+    // transitions to 'set'
+    void closure(std::vector<StateId> &set, StateId s, bool at_start){
+        stack.push_back(s);
+        while (!stack.empty()){
+            StateId id = stack.back();
+            stack.pop_back();
+            if (id == NO_STATE || visited[id] == stamp) continue;
+            visited[id] = stamp;
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+            case StateType::REPEAT:     // counts are not followed: only adds states
+                stack.push_back(curr.out1);
+                stack.push_back(curr.out);
+                break;
+            case StateType::SAVE:
+            case StateType::NEXT:
+                stack.push_back(curr.out);
+                break;
+            case StateType::ANCHOR_START:
+                // Past the first byte '^' can never hold again
+                if (at_start) saw_start_anchor = true;
+                break;
+            case StateType::ANCHOR_END:
+            case StateType::MATCH:
+                can_end = true;
+                break;
+            default:    // CHAR, DOT, CHAR_CLASS
+                set.push_back(id);
+                break;
+            }
+        }
+    }
+};
+
+#ifdef PREFILTER_SSE2
+
+// Position of the first byte of p[from .. n) equal to one of b0, b1, b2
+size_t find_any(const char *p, size_t n, size_t from, unsigned char b0, unsigned char b1, unsigned char b2){
+    const __m128i v0 = _mm_set1_epi8(static_cast<char>(b0));
+    const __m128i v1 = _mm_set1_epi8(static_cast<char>(b1));
+    const __m128i v2 = _mm_set1_epi8(static_cast<char>(b2));
+    size_t i = from;
+    for (; i + 16 <= n; i += 16){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, v0), _mm_cmpeq_epi8(chunk, v1)),
+                                  _mm_cmpeq_epi8(chunk, v2));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq));
+        if (mask) return i + static_cast<size_t>(std::countr_zero(mask));
+    }
+    for (; i < n; i++){
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        if (c == b0 || c == b1 || c == b2) return i;
+    }
+    return std::string_view::npos;
+}
+
+// Position of the first occurrence of a non-empty 'needle' in p[from .. n).
+// Blocks of 16 candidate positions are filtered by comparing both the first
+// and the last byte of the needle (a packed pair), so only positions where
+// both agree are verified with memcmp.
+size_t find_literal(std::string_view input, size_t from, const std::string &needle){
+    const char *p = input.data();
+    const size_t n = input.size();
+    const size_t len = needle.size();
+    if (len == 1){
+        const void *hit = from < n ? std::memchr(p + from, needle[0], n - from) : nullptr;
+        return hit ? static_cast<size_t>(static_cast<const char *>(hit) - p) : std::string_view::npos;
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    size_t i = from;
+    for (; i + len - 1 + 16 <= n; i += 16){
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + len - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+        while (mask){
+            size_t at = i + static_cast<size_t>(std::countr_zero(mask));
+            if (std::memcmp(p + at + 1, needle.data() + 1, len - 2) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+    return input.find(needle, i);
+}
+
+#else
+
+size_t find_any(const char *p, size_t n, size_t from, unsigned char b0, unsigned char b1, unsigned char b2){
+    for (size_t i = from; i < n; i++){
+        unsigned char c = static_cast<unsigned char>(p[i]);
+        if (c == b0 || c == b1 || c == b2) return i;
+    }
+    return std::string_view::npos;
+}
+
+size_t find_literal(std::string_view input, size_t from, const std::string &needle){
+    return input.find(needle, from);
+}
+
+#endif  // PREFILTER_SSE2
+
+// What is known about the strings matched by a subexpression. When 'exact'
+// is set the subexpression only matches one string, held in all three fields.
+struct Literals {
+    bool exact = false;
+    std::string prefix;     // every match starts with it
+    std::string suffix;     // every match ends with it
+    std::string inner;      // every match contains it
+};
+
+Literals exact_literal(std::string s){
+    return Literals{true, s, s, s};
+}
+
+const std::string &longest(const std::string &a, const std::string &b){
+    return b.size() > a.size() ? b : a;
+}
+
+// Keeps the strings short: a prefix or suffix of a required literal is still
+// required
+void truncate(Literals &l){
+    const size_t max = Prefilter::MAX_REQUIRED;
+    if (l.prefix.size() <= max && l.suffix.size() <= max && l.inner.size() <= max) return;
+    l.exact = false;
+    if (l.prefix.size() > max) l.prefix.resize(max);
+    if (l.suffix.size() > max) l.suffix.erase(0, l.suffix.size() - max);
+    if (l.inner.size() > max) l.inner.resize(max);
+}
+
+Literals concat(const Literals &a, const Literals &b){
+    Literals r;
+    r.exact = a.exact && b.exact;
+    r.prefix = a.exact ? a.prefix + b.prefix : a.prefix;
+    r.suffix = b.exact ? a.suffix + b.suffix : b.suffix;
+    // A literal can also span the boundary between both parts
+    r.inner = longest(a.inner, b.inner);
+    if (a.suffix.size() + b.prefix.size() > r.inner.size()) r.inner = a.suffix + b.prefix;
+    truncate(r);
+    return r;
+}
+
+// Longest common substring, by dynamic programming over both strings
+std::string common_substring(const std::string &a, const std::string &b){
+    std::vector<size_t> prev(b.size() + 1, 0), curr(b.size() + 1, 0);
+    size_t best = 0, best_end = 0;
+    for (size_t i = 1; i <= a.size(); i++){
+        for (size_t j = 1; j <= b.size(); j++){
+            curr[j] = (a[i - 1] == b[j - 1]) ? prev[j - 1] + 1 : 0;
+            if (curr[j] > best){
+                best = curr[j];
+                best_end = i;
+            }
+        }
+        std::swap(prev, curr);
+    }
+    return a.substr(best_end - best, best);
+}
+
+Literals alternate(const Literals &a, const Literals &b){
+    Literals r;
+    r.exact = a.exact && b.exact && a.prefix == b.prefix;
+    size_t p = 0;
+    while (p < a.prefix.size() && p < b.prefix.size() && a.prefix[p] == b.prefix[p]) p++;
+    r.prefix = a.prefix.substr(0, p);
+    size_t s = 0;
+    while (s < a.suffix.size() && s < b.suffix.size() &&
+           a.suffix[a.suffix.size() - 1 - s] == b.suffix[b.suffix.size() - 1 - s]) s++;
+    r.suffix = a.suffix.substr(a.suffix.size() - s);
+    r.inner = longest(r.prefix, r.suffix);
+    if (a.inner == b.inner) r.inner = a.inner;
+    else if (!a.inner.empty() && !b.inner.empty()) r.inner = longest(r.inner, common_substring(a.inner, b.inner));
+    return r;
+}
+
+// e{min,max} with min >= 1: every match starts with 'min' instances of 'e'
+// and ends with one
+Literals repeat(const Literals &e, int min, int max){
+    Literals r = e;
+    // Past MAX_REQUIRED + 2 instances nothing changes any more
+    int copies = std::min(min, static_cast<int>(Prefilter::MAX_REQUIRED) + 2);
+    for (int i = 1; i < copies; i++) r = concat(r, e);
+    if (max != min) r.exact = false;
+    return r;
+}
+
+// Folds the tree bottom-up, the same way NfaBuilder combines its fragments,
+// into what is known about the literals of every match
+Literals fold(const Ast &ast){
+    std::vector<Literals> stack;
+    auto pop = [&](){
+        if (stack.empty()) throw std::runtime_error("Syntax Error: operator is missing an operand");
+        Literals l = std::move(stack.back());
+        stack.pop_back();
+        return l;
+    };
+
+    for (const auto &t : ast.nodes){
+        switch (t.type){
+        case TokenType::LITERAL:
+            stack.push_back(exact_literal(std::string(1, t.literal)));
+            break;
+        case TokenType::CARET:
+        case TokenType::DOLLAR:
+        case TokenType::LPAREN:
+            // Zero-width: they match the empty string
+            stack.push_back(exact_literal(""));
+            break;
+        case TokenType::DOT:
+        case TokenType::CHAR_CLASS:
+            stack.push_back(Literals{});
+            break;
+        case TokenType::RPAREN:
+        case TokenType::CONCAT:
+        {
+            Literals e2 = pop();
+            Literals e1 = pop();
+            stack.push_back(concat(e1, e2));
+            break;
+        }
+        case TokenType::ALTERNATION:
+        {
+            Literals e2 = pop();
+            Literals e1 = pop();
+            stack.push_back(alternate(e1, e2));
+            break;
+        }
+        case TokenType::STAR:
+        case TokenType::QUESTION:
+            pop();
+            stack.push_back(Literals{});    // may match nothing
+            break;
+        case TokenType::PLUS:
+            stack.push_back(repeat(pop(), 1, -1));
+            break;
+        case TokenType::QUANTIFIER_RANGE:
+        {
+            Literals e = pop();
+            stack.push_back(t.min == 0 ? Literals{} : repeat(e, t.min, t.max));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Whatever is left is implicitly concatenated
+    Literals result = exact_literal("");
+    for (const Literals &l : stack) result = concat(result, l);
+    return result;
+}
+
+}  // namespace
+
+std::string Prefilter::required_literal(const Ast &ast){
+    return fold(ast).inner;
+}
+
+// Walks the program from its start one byte at a time: as long as every
+// thread that is still alive expects the same character, that character is
+// part of the prefix.
+Prefilter Prefilter::compute(const Program &prog, const Ast &ast){
+    Prefilter result;
+    Literals literals = fold(ast);
+    result.inner = std::move(literals.inner);
+    result.suffix = std::move(literals.suffix);
+    if (prog.start == NO_STATE) return result;
+
+    Walker w(prog);
+    std::vector<StateId> set, next;
+    w.reset();
+    w.closure(set, prog.start, true);
+    if (w.saw_start_anchor || w.can_end) return result;
+
+    // Possible first bytes
+    std::array<bool, 256> seen{};
+    size_t count = 0;
+    auto add = [&](unsigned char b){
+        if (seen[b]) return true;
+        seen[b] = true;
+        if (count == MAX_FIRST_BYTES) return false;
+        result.first[count++] = b;
+        return true;
+    };
+    for (StateId id : set){
+        const State &s = prog[id];
+        bool fits = true;
+        if (s.type == StateType::CHAR){
+            fits = add(static_cast<unsigned char>(s.c));
+        }else if (s.type == StateType::DOT){
+            fits = false;
+        }else{
+            for (int b = 0; b < 256 && fits; b++){
+                if (prog.accepts(s, static_cast<char>(b))) fits = add(static_cast<unsigned char>(b));
+            }
+        }
+        if (!fits) return result;
+    }
+
+    // Literal prefix
+    while (result.prefix.size() < MAX_LITERAL && !set.empty()){
+        char c = prog[set[0]].c;
+        bool same = true;
+        for (StateId id : set){
+            if (prog[id].type != StateType::CHAR || prog[id].c != c){
+                same = false;
+                break;
+            }
+        }
+        if (!same) break;
+        result.prefix.push_back(c);
+
+        next.clear();
+        w.reset();
+        for (StateId id : set) w.closure(next, prog[id].out, false);
+        if (w.can_end) break;
+        set.swap(next);
+    }
+
+    // Input without the prefix is already rejected by find()
+    if (result.prefix.find(result.inner) != std::string::npos) result.inner.clear();
+    result.num_first = count;
+    return result;
+}
+
+size_t Prefilter::find(std::string_view input, size_t from) const{
+    if (from >= input.size()) return std::string_view::npos;
+    if (prefix.size() >= 2) return find_literal(input, from, prefix);
+
+    const char *p = input.data();
+    if (num_first == 1){
+        const void *hit = std::memchr(p + from, first[0], input.size() - from);
+        return hit ? static_cast<size_t>(static_cast<const char *>(hit) - p) : std::string_view::npos;
+    }
+    // With two first bytes the second one is simply tested twice
+    return find_any(p, input.size(), from, first[0], first[1], num_first == 3 ? first[2] : first[1]);
+}
+
+size_t Prefilter::find_suffix(std::string_view input, size_t from) const{
+    if (suffix.empty() || from >= input.size()) return std::string_view::npos;
+    return find_literal(input, from, suffix);
+}
+
+bool Prefilter::may_match(std::string_view input) const{
+    return inner.empty() || find_literal(input, 0, inner) != std::string_view::npos;
+}
+
+// Time Complexity Analysis:
+
+// m = number of NFA states, L = length of the literal prefix (at most MAX_LITERAL)
+// n = input length
+
+// compute():
+// One epsilon closure per prefix byte, each O(m), plus 256 tests per class
+// among the first states → O((L + 1) * m)
+
+// required_literal():
+// One step per node; the strings involved are at most MAX_REQUIRED
+// bytes long, so concatenation is O(MAX_REQUIRED) and an alternation's common
+// substring O(MAX_REQUIRED^2) → O(T * MAX_REQUIRED^2) for T nodes
+
+// find() / find_suffix() / may_match():
+// One pass over the skipped input, 16 bytes per step with SSE2 → O(n),
+// plus an O(L) memcmp for every position whose first and last bytes agree
+// with the literal
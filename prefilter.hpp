@@ -0,0 +1,63 @@
+#ifndef PREFILTER_HPP
+#define PREFILTER_HPP
+#include "ast.hpp"
+#include <array>
+
+struct Program;
+
+// Literal facts about every match of a program, used to avoid running the
+// automaton over input that cannot match:
+//
+// - what a match must start with: a literal prefix (for "ERROR: (.*)",
+//   "ERROR: ") or, failing that, one of at most three first bytes. Searches
+//   use it to jump straight to the next position where a match can start,
+//   which keeps mostly non-matching input close to memory bandwidth.
+//   Patterns that can match the empty string, or that are anchored at the
+//   start, get no prefix skipping (is_active() is false).
+//
+// - a literal that every match must contain (for "[a-z]+@example\.com",
+//   "@example.com"), so that input without it is rejected by a single
+//   substring search before any automaton runs.
+//
+// - a literal that every match must end with (for ".*\.json", ".json"), so
+//   that a search can jump to its occurrences and check backwards from there
+//   whether a match ends right after them.
+class Prefilter
+{
+public:
+    static constexpr size_t MAX_LITERAL = 32;
+    static constexpr size_t MAX_FIRST_BYTES = 3;
+    static constexpr size_t MAX_REQUIRED = 64;
+
+    // 'ast' is the pattern the program was built from
+    static Prefilter compute(const Program &prog, const Ast &ast);
+
+    // Longest literal found in every match of the pattern (possibly empty)
+    static std::string required_literal(const Ast &ast);
+
+    bool is_active() const { return num_first > 0; }
+
+    // Smallest position >= 'from' where a match can start, or
+    // std::string_view::npos if there is none. Only meaningful when active.
+    size_t find(std::string_view input, size_t from) const;
+
+    // False if the input cannot contain a match
+    bool may_match(std::string_view input) const;
+
+    // Smallest position >= 'from' where the required suffix occurs, or
+    // std::string_view::npos if there is none (or no suffix is known)
+    size_t find_suffix(std::string_view input, size_t from) const;
+
+    const std::string &literal() const { return prefix; }
+    const std::string &required() const { return inner; }
+    const std::string &required_suffix() const { return suffix; }
+
+private:
+    std::string prefix;                                 // may be empty
+    std::string inner;                                  // checked by may_match(), may be empty
+    std::string suffix;                                 // may be empty
+    std::array<unsigned char, MAX_FIRST_BYTES> first{}; // possible first bytes
+    size_t num_first = 0;
+};
+
+#endif  // PREFILTER_HPP
@@ -0,0 +1,290 @@
+#include "regex.hpp"
+
+Regex::Regex(std::string_view pattern, RegexOptions options)
+    : Regex(checked(Parser::parse(pattern, options.limits.max_depth), options), options) {}
+
+// Neither program is larger than NfaBuilder::estimate() says, so the check
+// costs one pass over the tree and nothing is allocated for a pattern that
+// fails it
+const Ast &Regex::checked(const Ast &ast, const RegexOptions &options){
+    const CompileLimits &limits = options.limits;
+    NfaBuilder::Estimate size = NfaBuilder::estimate(ast, true);
+    if (size.depth > limits.max_depth) throw CompileError(CompileError::Kind::DEPTH, size.depth, limits.max_depth);
+    if (size.states > limits.max_states) throw CompileError(CompileError::Kind::STATES, size.states, limits.max_states);
+    if (2 * size.memory() > limits.max_memory){
+        throw CompileError(CompileError::Kind::MEMORY, 2 * size.memory(), limits.max_memory);
+    }
+    if (options.shared_dfa && options.shared_dfa_budget > limits.max_dfa_cache){
+        throw CompileError(CompileError::Kind::DFA_CACHE, options.shared_dfa_budget, limits.max_dfa_cache);
+    }
+    return ast;
+}
+
+Regex::Regex(const Ast &ast, const RegexOptions &options)
+    : prog(NfaBuilder().build(ast, options.captures, true)), reverse_prog(NfaBuilder().build_reverse(ast, true)),
+      counted(!prog.counters.empty()), dfa_budget(std::min(LazyDfa::DEFAULT_CACHE_BUDGET, options.limits.max_dfa_cache)),
+      onepass(OnePass::compile(prog)){
+    if (options.shared_dfa && !counted){
+        shared_dfa = std::make_unique<SharedDfa>(prog, options.shared_dfa_budget);
+        shared_reverse_dfa = std::make_unique<SharedDfa>(reverse_prog, options.shared_dfa_budget);
+    }
+    for (const State &s : prog.states){
+        if (s.type == StateType::ANCHOR_START) has_start_anchor = true;
+        if (s.type == StateType::ANCHOR_END) has_end_anchor = true;
+    }
+    std::vector<std::string> alternatives;
+    if (AhoCorasick::literal_alternatives(ast, alternatives)){
+        literals = std::make_unique<AhoCorasick>(alternatives);
+    }
+    // Skipping to the first bytes of a match is cheaper when it is possible
+    by_suffix = !literals && !counted && !prog.prefilter.is_active() && prog.prefilter.required_suffix().size() >= 2;
+}
+
+size_t Regex::memory_usage() const{
+    size_t total = sizeof(Regex) + prog.memory_usage() + reverse_prog.memory_usage() +
+                   (onepass ? onepass->memory_usage() : 0) + (literals ? literals->memory_usage() : 0);
+    for (const SharedDfa *dfa : {shared_dfa.get(), shared_reverse_dfa.get()}){
+        if (dfa) total += dfa->memory_usage();
+    }
+    return total + pool_memory.load(std::memory_order_relaxed);
+}
+
+size_t Regex::pooled_size(const Cache &cache){
+    return sizeof(Cache) + cache.dfa.memory_usage() + cache.reverse_dfa.memory_usage();
+}
+
+Regex::Cache::Cache(const Regex &regex)
+    : owner(&regex), dfa(regex.prog, regex.dfa_budget), reverse_dfa(regex.reverse_prog, regex.dfa_budget),
+      bt(regex.prog), vm(regex.prog) {}
+
+// A full shared cache sends the search to the thread's own lazy DFA
+bool Regex::dfa_is_match(std::string_view input, Cache &cache) const{
+    if (shared_dfa){
+        int found = shared_dfa->is_match(input, cache.scratch);
+        if (found >= 0) return found;
+    }
+    return cache.dfa.is_match(input);
+}
+
+bool Regex::dfa_full_match(std::string_view input, Cache &cache) const{
+    if (shared_dfa){
+        int found = shared_dfa->full_match(input, cache.scratch);
+        if (found >= 0) return found;
+    }
+    return cache.dfa.full_match(input);
+}
+
+size_t Regex::dfa_find_end(std::string_view input, Cache &cache) const{
+    if (shared_dfa){
+        size_t end = shared_dfa->find_end(input, cache.scratch);
+        if (end != SharedDfa::CACHE_FULL) return end;
+    }
+    return cache.dfa.find_end(input);
+}
+
+size_t Regex::dfa_find_start(std::string_view input, size_t end, Cache &cache) const{
+    if (shared_reverse_dfa){
+        size_t start = shared_reverse_dfa->find_start(input, end, cache.scratch);
+        if (start != SharedDfa::CACHE_FULL) return start;
+    }
+    return cache.reverse_dfa.find_start(input, end);
+}
+
+// -1 from the shared DFA with some limit left means its cache is full
+int Regex::dfa_ends_at(std::string_view input, size_t end, size_t &limit, Cache &cache) const{
+    if (shared_reverse_dfa){
+        int found = shared_reverse_dfa->ends_at(input, end, limit, cache.scratch);
+        if (found >= 0 || limit == 0) return found;
+    }
+    return cache.reverse_dfa.ends_at(input, end, limit);
+}
+
+Regex::Borrowed::Borrowed(const Regex &r) : regex(r){
+    {
+        std::lock_guard<std::mutex> lock(regex.pool_mutex);
+        if (!regex.pool.empty()){
+            cache = std::move(regex.pool.back());
+            regex.pool.pop_back();
+            regex.pool_memory.fetch_sub(pooled_size(*cache), std::memory_order_relaxed);
+        }
+    }
+    if (!cache) cache = std::make_unique<Cache>(regex);
+}
+
+Regex::Borrowed::~Borrowed(){
+    std::lock_guard<std::mutex> lock(regex.pool_mutex);
+    regex.pool_memory.fetch_add(pooled_size(*cache), std::memory_order_relaxed);
+    regex.pool.push_back(std::move(cache));
+}
+
+void Regex::check(const Cache &cache) const{
+    if (cache.owner != this) throw std::runtime_error("Regex::Cache used with a different Regex");
+}
+
+bool Regex::is_match(std::string_view input) const{
+    if (literals) return literals->find(input, nullptr, &prog.prefilter);
+    Borrowed cache(*this);
+    return is_match(input, *cache);
+}
+
+bool Regex::search(std::string_view input, Captures *caps) const{
+    Borrowed cache(*this);
+    return search(input, *cache, caps);
+}
+
+bool Regex::full_match(std::string_view input, Captures *caps) const{
+    Borrowed cache(*this);
+    return full_match(input, *cache, caps);
+}
+
+void Regex::match_batch(std::span<const std::string_view> inputs, std::vector<bool> &matched) const{
+    Borrowed cache(*this);
+    match_batch(inputs, *cache, matched);
+}
+
+void Regex::match_batch(std::span<const std::string_view> inputs, std::vector<size_t> &indices) const{
+    Borrowed cache(*this);
+    match_batch(inputs, *cache, indices);
+}
+
+// Inputs go through the interleaved forward scan when is_match() would use
+// the lazy DFA; the other routes (Aho-Corasick, the NFA engines, backwards
+// from '$' or from a suffix, the shared DFA) answer one input at a time.
+void Regex::match_batch(std::span<const std::string_view> inputs, Cache &cache, std::vector<bool> &matched) const{
+    check(cache);
+    if (literals || counted || reverse_prog.anchored || by_suffix || shared_dfa){
+        matched.assign(inputs.size(), false);
+        for (size_t i = 0; i < inputs.size(); i++) matched[i] = is_match(inputs[i], cache);
+        return;
+    }
+    cache.dfa.is_match_batch(inputs, matched);
+}
+
+void Regex::match_batch(std::span<const std::string_view> inputs, Cache &cache, std::vector<size_t> &indices) const{
+    match_batch(inputs, cache, cache.batch);
+    indices.clear();
+    for (size_t i = 0; i < inputs.size(); i++){
+        if (cache.batch[i]) indices.push_back(i);
+    }
+}
+
+bool Regex::is_match(std::string_view input, Cache &cache) const{
+    check(cache);
+    if (literals) return literals->find(input, nullptr, &prog.prefilter);
+    if (counted) return nfa_search(input, cache, nullptr);
+    if (reverse_prog.anchored){
+        size_t unlimited = std::numeric_limits<size_t>::max();
+        return dfa_ends_at(input, input.size(), unlimited, cache) == 1;
+    }
+    if (by_suffix) return is_match_by_suffix(input, cache);
+    return dfa_is_match(input, cache);
+}
+
+// Every match ends right after an occurrence of the suffix, so the reversed
+// DFA only runs backwards from those. The backward scans may read as many
+// bytes as the input holds in total; past that (many occurrences that each
+// need a long scan) the forward DFA answers instead, so the search stays
+// linear.
+bool Regex::is_match_by_suffix(std::string_view input, Cache &cache) const{
+    const Prefilter &pre = prog.prefilter;
+    const size_t len = pre.required_suffix().size();
+    size_t budget = input.size();
+    for (size_t at = pre.find_suffix(input, 0); at != std::string_view::npos; at = pre.find_suffix(input, at + 1)){
+        int found = dfa_ends_at(input, at + len, budget, cache);
+        if (found == 1) return true;
+        if (found == -1) return dfa_is_match(input, cache);
+    }
+    return false;
+}
+
+// Aho-Corasick gives the span of the match but not the groups inside it
+bool Regex::search(std::string_view input, Cache &cache, Captures *caps) const{
+    if (!caps) return is_match(input, cache);
+    check(cache);
+    if (literals && num_groups() == 1){
+        AhoCorasick::Match m;
+        if (!literals->find(input, &m, &prog.prefilter)) return false;
+        *caps = {m.start, m.end};
+        return true;
+    }
+    if (onepass && onepass->is_anchored()) return onepass->search(input, caps);
+    if (counted) return nfa_search(input, cache, caps);
+
+    // With '$' on every path the end is known without a forward scan
+    size_t end = reverse_prog.anchored ? input.size() : dfa_find_end(input, cache);
+    if (end == std::string_view::npos) return false;
+    size_t start = dfa_find_start(input, end, cache);
+    if (start == std::string_view::npos) return false;
+    if (num_groups() == 1){
+        *caps = {start, end};
+        return true;
+    }
+
+    // '^' and '$' hold at the edges of the span only if those are the edges
+    // of the input
+    bool same_anchors = (!has_start_anchor || start == 0) && (!has_end_anchor || end == input.size());
+    if (same_anchors && captures_in(input, start, end, cache, caps)) return true;
+    return nfa_search(input, cache, caps);
+}
+
+// The backtracker when the input fits its budget, the Pike VM otherwise
+bool Regex::nfa_search(std::string_view input, Cache &cache, Captures *caps) const{
+    if (cache.bt.can_run(input.size())) return cache.bt.search(input, caps);
+    return cache.vm.search(input, caps);
+}
+
+// The leftmost-first match is the highest-priority path that starts at
+// 'start', and it ends at 'end', so it is also the path a full match of
+// input[start, end) picks, as long as the anchors see the same thing.
+bool Regex::captures_in(std::string_view input, size_t start, size_t end, Cache &cache, Captures *caps) const{
+    std::string_view span = input.substr(start, end - start);
+    bool found = onepass ? onepass->match(span, caps)
+               : cache.bt.can_run(span.size()) ? cache.bt.match(span, caps)
+               : cache.vm.match(span, caps);
+    if (!found) return false;
+    for (size_t &pos : *caps){
+        if (pos != NO_POS) pos += start;
+    }
+    return true;
+}
+
+bool Regex::full_match(std::string_view input, Cache &cache, Captures *caps) const{
+    check(cache);
+    if (caps || counted){
+        if (onepass) return onepass->match(input, caps);
+        if (cache.bt.can_run(input.size())) return cache.bt.match(input, caps);
+        return cache.vm.match(input, caps);
+    }
+    return dfa_full_match(input, cache);
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states
+
+// Construction:
+// O(p) to parse (see Parser), O(T) (T = number of AST nodes) to check the
+// limits, then the builds (see NfaBuilder) and the one-pass DFA
+
+// is_match():
+// O(n) for literal patterns (see AhoCorasick), otherwise the cost of the lazy
+// DFA (O(n) with a warm cache). Patterns ending in '$' only read the input
+// back from its end until the answer is known; suffix scans read at most n
+// bytes before the forward DFA takes over → O(n) either way.
+
+// match_batch():
+// The sum of is_match() over the inputs, without the per-call setup
+
+// search():
+// The two lazy DFA scans, O(n) with warm caches, plus the capture engine over
+// the span only: O(k) for the one-pass DFA, O(k * m) for the backtracker or
+// the Pike VM (k = length of the match)
+
+// With counted loops, every query is one run of the backtracker or the Pike
+// VM over the input → O(n * m), m counting (state, count) pairs
+
+// Cache pool:
+// Borrowing and returning a cache is O(1) under a mutex held for a pointer
+// move and the update of the pool's size; a new cache is only built when
+// every pooled one is in use. memory_usage() is O(1) and takes no lock but
+// the shared DFAs' own
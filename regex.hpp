@@ -0,0 +1,178 @@
+#ifndef REGEX_HPP
+#define REGEX_HPP
+#include "nfa_builder.hpp"
+#include "pike_vm.hpp"
+#include "backtrack.hpp"
+#include "onepass.hpp"
+#include "lazy_dfa.hpp"
+#include "shared_dfa.hpp"
+#include "aho_corasick.hpp"
+#include <atomic>
+#include <mutex>
+
+// A compiled pattern together with the engines that run it.
+// The pattern is compiled once (Parser -> NfaBuilder)
+// and each query is routed to the cheapest engine that can answer it:
+// - patterns made only of literals (foo|bar|baz) use an Aho-Corasick automaton
+// - "is there a match" uses the lazy DFA, except for patterns whose matches
+//   all end at the end of the input ('$'), which are checked by scanning the
+//   reversed pattern backwards from there and stop as soon as the answer is
+//   known, and for patterns whose matches all end with a literal suffix,
+//   which jump to the suffix's occurrences and check backwards from each one
+// - spans use the lazy DFA to find where the match ends (known up front with
+//   '$'), then a lazy DFA over the reversed pattern, anchored at that end, to
+//   find where it starts
+// - captures are then resolved inside that span by the one-pass DFA, the
+//   bounded backtracker (when the span is short enough for its visited
+//   bitset) or the Pike VM; when an anchor would see different input at the
+//   edges of the span, those engines run over the whole input. Anchored
+//   one-pass patterns skip the DFAs and use the one-pass DFA directly.
+// - patterns with a count too large to expand (see NfaBuilder::MAX_COPIES)
+//   are compiled with counted loops, which no DFA can run: every query goes
+//   to the backtracker or the Pike VM, which follow the counts
+//
+// A compiled Regex is immutable: the programs, the one-pass DFA and the
+// Aho-Corasick automaton are only read while matching. Everything an engine
+// writes to (DFA state caches, thread lists, the visited bitset) lives in a
+// Regex::Cache, so one Regex can be shared by any number of threads as long
+// as each thread matches with its own Cache. The overloads without a Cache
+// borrow one from a small pool inside the Regex and are thread-safe too.
+//
+// With RegexOptions::shared_dfa, the lazy DFAs also share their states
+// between threads (see SharedDfa); each Cache keeps its own lazy DFAs only
+// as a fallback for when the shared cache is full.
+//
+// RegexOptions::limits bound what a pattern may cost to compile; a pattern
+// over them is rejected with a CompileError before anything is built.
+//
+// Without RegexOptions::captures, only group 0 (the span of the match) is
+// reported and the program carries no SAVE states for the other groups,
+// which callers that never look at groups get for free.
+struct RegexOptions {
+    bool shared_dfa = false;
+    size_t shared_dfa_budget = SharedDfa::DEFAULT_CACHE_BUDGET;     // for each direction
+    CompileLimits limits{};
+    bool captures = true;
+};
+
+class Regex
+{
+public:
+    // Mutable scratch for one thread at a time. Reusable across calls, so
+    // the DFA caches stay warm; only valid with the Regex that created it.
+    class Cache
+    {
+    public:
+        explicit Cache(const Regex &regex);
+
+    private:
+        friend class Regex;
+        const Regex *owner;
+        LazyDfa dfa;
+        LazyDfa reverse_dfa;    // over reverse_prog
+        SharedDfa::Scratch scratch;
+        Backtracker bt;
+        PikeVM vm;
+        std::vector<bool> batch;    // match_batch() into indices
+    };
+
+    // Throws std::runtime_error if the pattern does not compile, CompileError
+    // if it is over options.limits
+    explicit Regex(std::string_view pattern, RegexOptions options = {});
+
+    Cache create_cache() const { return Cache(*this); }
+
+    // True if some substring of the input matches
+    bool is_match(std::string_view input, Cache &cache) const;
+    bool is_match(std::string_view input) const;
+
+    // Leftmost-first match and its groups, like PikeVM::search
+    bool search(std::string_view input, Cache &cache, Captures *caps = nullptr) const;
+    bool search(std::string_view input, Captures *caps = nullptr) const;
+
+    // True if the whole input matches
+    bool full_match(std::string_view input, Cache &cache, Captures *caps = nullptr) const;
+    bool full_match(std::string_view input, Captures *caps = nullptr) const;
+
+    // is_match() for many inputs at once, as a bitmap (matched[i] for
+    // inputs[i]) or as the increasing indices of the inputs that match.
+    // Setup is paid once per batch, and short inputs are scanned several at a
+    // time by the lazy DFA (see LazyDfa::is_match_batch).
+    void match_batch(std::span<const std::string_view> inputs, Cache &cache, std::vector<bool> &matched) const;
+    void match_batch(std::span<const std::string_view> inputs, Cache &cache, std::vector<size_t> &indices) const;
+    void match_batch(std::span<const std::string_view> inputs, std::vector<bool> &matched) const;
+    void match_batch(std::span<const std::string_view> inputs, std::vector<size_t> &indices) const;
+
+    size_t num_groups() const { return prog.num_slots / 2; }
+
+    // Bytes held by the Regex now: both programs, the one-pass DFA, the
+    // Aho-Corasick automaton, the shared DFAs' reserved tables and the lazy
+    // DFA caches of its idle pooled Caches. Grows as the pooled caches fill
+    // (up to 2 x the lazy DFA budget per Cache); Caches made with
+    // create_cache() or lent out at the moment are not counted.
+    size_t memory_usage() const;
+    const Program &program() const { return prog; }
+
+    // True if the pattern is routed to Aho-Corasick
+    bool is_literal() const { return literals != nullptr; }
+
+    // Caches refer to the programs, so a Regex stays where it was built
+    Regex(const Regex &) = delete;
+    Regex &operator=(const Regex &) = delete;
+
+private:
+    Regex(const Ast &ast, const RegexOptions &options);
+
+    // Throws CompileError if 'ast' is over the limits of 'options'
+    static const Ast &checked(const Ast &ast, const RegexOptions &options);
+
+    // Takes a Cache out of the pool (or makes one) and puts it back when done
+    class Borrowed
+    {
+    public:
+        explicit Borrowed(const Regex &regex);
+        ~Borrowed();
+        Borrowed(const Borrowed &) = delete;
+        Borrowed &operator=(const Borrowed &) = delete;
+        Cache &operator*() { return *cache; }
+
+    private:
+        const Regex &regex;
+        std::unique_ptr<Cache> cache;
+    };
+
+    void check(const Cache &cache) const;
+    static size_t pooled_size(const Cache &cache);
+
+    // The lazy DFA searches, on the shared DFAs when there are any
+    bool dfa_is_match(std::string_view input, Cache &cache) const;
+    bool dfa_full_match(std::string_view input, Cache &cache) const;
+    size_t dfa_find_end(std::string_view input, Cache &cache) const;
+    size_t dfa_find_start(std::string_view input, size_t end, Cache &cache) const;
+    int dfa_ends_at(std::string_view input, size_t end, size_t &limit, Cache &cache) const;
+
+    bool captures_in(std::string_view input, size_t start, size_t end, Cache &cache, Captures *caps) const;
+    bool nfa_search(std::string_view input, Cache &cache, Captures *caps) const;
+    bool is_match_by_suffix(std::string_view input, Cache &cache) const;
+
+    Program prog;
+    Program reverse_prog;       // reverse_prog.anchored: every match ends at the end of the input
+    bool has_start_anchor = false;
+    bool has_end_anchor = false;
+    bool by_suffix = false;     // is_match() jumps to the required suffix
+    bool counted = false;       // the programs have counted loops, so no DFA runs them
+    size_t dfa_budget;          // of the lazy DFAs of each Cache
+    std::unique_ptr<AhoCorasick> literals;
+    std::unique_ptr<OnePass> onepass;   // null if the program is not one-pass
+    std::unique_ptr<SharedDfa> shared_dfa, shared_reverse_dfa;  // null unless RegexOptions::shared_dfa
+
+    // Idle caches for the overloads without a Cache; at most one per thread
+    // that ever used them at the same time
+    mutable std::mutex pool_mutex;
+    mutable std::vector<std::unique_ptr<Cache>> pool;
+    // Bytes held by the pooled caches, kept as they come and go so that
+    // memory_usage() does not take pool_mutex
+    mutable std::atomic<size_t> pool_memory{0};
+};
+
+#endif  // REGEX_HPP
@@ -0,0 +1,117 @@
+#include "regex_cache.hpp"
+
+RegexCache::RegexCache(size_t memory_budget) : budget(memory_budget) {}
+
+RegexCache &RegexCache::global(){
+    static RegexCache cache;
+    return cache;
+}
+
+// The options come first, in a form that cannot contain ':', so no two
+// (pattern, options) pairs share a key. The limits are part of it: a pattern
+// compiled under loose limits must not be handed out under strict ones.
+std::string RegexCache::make_key(std::string_view pattern, const RegexOptions &options){
+    const CompileLimits &l = options.limits;
+    std::string key = options.shared_dfa ? "s" + std::to_string(options.shared_dfa_budget) : "-";
+    for (size_t limit : {l.max_states, l.max_memory, l.max_depth, l.max_dfa_cache}) key += "," + std::to_string(limit);
+    if (!options.captures) key += ",nocap";
+    key += ':';
+    key += pattern;
+    return key;
+}
+
+// Threads take shards in the order they first count a hit
+size_t RegexCache::shard(){
+    static std::atomic<size_t> next{0};
+    thread_local size_t mine = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return mine;
+}
+
+std::shared_ptr<const Regex> RegexCache::get(std::string_view pattern, const RegexOptions &options){
+    std::string key = make_key(pattern, options);
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()){
+            const Entry &entry = it->second;
+            if (!entry.referenced.load(std::memory_order_relaxed)) entry.referenced.store(true, std::memory_order_relaxed);
+            hits[shard()].hits.fetch_add(1, std::memory_order_relaxed);
+            return entry.regex;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    // Compiled without the lock; a thread that compiled the same pattern
+    // meanwhile wins and this copy is dropped
+    auto regex = std::make_shared<const Regex>(pattern, options);
+    size_t size = regex->memory_usage();
+    if (size > budget) return regex;
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto [it, inserted] = entries.try_emplace(std::move(key), regex, size);
+    if (!inserted) return it->second.regex;
+    memory += size;
+    // Behind the hand, so that it is the last entry the hand reaches
+    ring.insert(hand, &*it);
+    for (size_t i = 0; i < MEASURED_PER_MISS && i + 1 < ring.size(); i++){
+        if (sample == ring.end()) sample = ring.begin();
+        if (*sample != &*it) measure(**sample);
+        ++sample;
+    }
+    while (memory > budget && entries.size() > 1) evict_one(&*it);
+    return regex;
+}
+
+void RegexCache::measure(Map::value_type &entry){
+    size_t size = entry.second.regex->memory_usage();
+    memory = memory - entry.second.memory + size;
+    entry.second.memory = size;
+}
+
+// Called with the exclusive lock held and at least two entries; 'keep', the
+// entry just inserted, is never the victim. Every entry the hand passes loses
+// its mark, so the sweep ends within one turn of the clock; a turn is paid
+// for by the hits that set the marks.
+void RegexCache::evict_one(const Map::value_type *keep){
+    for (;; ++hand){
+        if (hand == ring.end()) hand = ring.begin();
+        Map::value_type *entry = *hand;
+        if (entry == keep) continue;
+        measure(*entry);
+        if (entry->second.referenced.exchange(false, std::memory_order_relaxed)) continue;
+        if (sample == hand) ++sample;
+        hand = ring.erase(hand);
+        memory -= entry->second.memory;
+        entries.erase(entry->first);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+RegexCache::Stats RegexCache::stats() const{
+    size_t hit_count = 0;
+    for (const Shard &s : hits) hit_count += s.hits.load(std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return Stats{hit_count, misses.load(), evictions.load(), entries.size(), memory};
+}
+
+void RegexCache::clear(){
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    ring.clear();
+    entries.clear();
+    hand = sample = ring.end();
+    memory = 0;
+}
+
+// Time Complexity Analysis:
+
+// p = pattern length, e = number of entries
+
+// get():
+// A hit hashes the key, O(p), under a shared lock, so hits from different
+// threads run in parallel; it writes the entry's mark once per turn of the
+// clock and its thread's hit shard. A miss adds the compilation (see
+// NfaBuilder), O(1) to put the entry in the ring behind the hand, and
+// MEASURED_PER_MISS + 1 calls to Regex::memory_usage(), O(1) each.
+// Eviction is amortized O(1) (plus the O(p) erase) per evicted entry: the
+// hand clears a mark for each entry it passes, and each mark was set by a hit.
@@ -0,0 +1,99 @@
+#ifndef REGEX_CACHE_HPP
+#define REGEX_CACHE_HPP
+#include "regex.hpp"
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+#include <list>
+#include <unordered_map>
+
+// Compiled patterns keyed by pattern string and options, so a pattern that
+// comes back is not run through Parser -> NfaBuilder again.
+//
+// Lookups that hit take a shared lock only. Recency is a CLOCK: a hit marks
+// its entry, and only the first hit since the clock hand last passed writes
+// the mark, so hits on hot entries read shared memory without writing it.
+// The hit count is spread over cache-line-sized shards, one per thread
+// (modulo the shard count), so hits do not all write the same line. Misses
+// compile without any lock and then insert under the exclusive lock; the
+// hand then sweeps the entries, clearing marks and evicting the first entry
+// it finds unmarked, until the entries fit in the budget again.
+//
+// The budget covers Regex::memory_usage() of every entry: the automata, the
+// shared DFAs' reserved tables and the lazy DFA caches of each Regex's idle
+// pooled Caches, which grow as the Regex is used. Sizes are sampled: each
+// miss measures the new entry, the next few entries in clock order and every
+// entry the hand passes, so a miss does not walk the whole cache. In between,
+// the cache runs over its budget by what matching has added to DFA caches
+// not measured again yet. Caches held by callers (Regex::create_cache) are
+// theirs and not counted.
+//
+// Entries are handed out as shared_ptr<const Regex>: a Regex is immutable
+// and thread-safe, and one that is evicted while in use stays alive until
+// its last user lets go.
+class RegexCache
+{
+public:
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t entries = 0;
+        size_t memory = 0;      // bytes held by the entries, as last measured
+    };
+
+    explicit RegexCache(size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+
+    // The compiled pattern, compiled now if it is not cached. Throws
+    // std::runtime_error if the pattern does not compile; failures are not
+    // cached. A pattern bigger than the whole budget is compiled and returned
+    // but not kept.
+    std::shared_ptr<const Regex> get(std::string_view pattern, const RegexOptions &options = {});
+
+    Stats stats() const;
+    void clear();
+
+    // The process-wide cache, with the default budget
+    static RegexCache &global();
+
+    RegexCache(const RegexCache &) = delete;
+    RegexCache &operator=(const RegexCache &) = delete;
+
+private:
+    struct Entry {
+        std::shared_ptr<const Regex> regex;
+        size_t memory;  // Regex::memory_usage() when last measured
+        mutable std::atomic<bool> referenced{false};    // hit since the hand last passed
+    };
+    using Map = std::unordered_map<std::string, Entry>;
+
+    // Entries in clock order; pointers into 'entries' stay valid across rehashes
+    using Ring = std::list<Map::value_type *>;
+
+    struct alignas(64) Shard {
+        std::atomic<size_t> hits{0};
+    };
+    static constexpr size_t SHARDS = 16;
+
+    static std::string make_key(std::string_view pattern, const RegexOptions &options);
+    static size_t shard();
+    void measure(Map::value_type &entry);
+    void evict_one(const Map::value_type *keep);
+
+    // Entries measured again at each miss, beyond the new one
+    static constexpr size_t MEASURED_PER_MISS = 4;
+
+    size_t budget;
+    mutable std::shared_mutex mutex;
+    Map entries;            // guarded by 'mutex'
+    Ring ring;              // guarded by 'mutex'
+    Ring::iterator hand = ring.end();       // guarded by 'mutex': next entry for the clock hand
+    Ring::iterator sample = ring.end();     // guarded by 'mutex': next entry to measure again
+    size_t memory = 0;      // guarded by 'mutex'
+    std::array<Shard, SHARDS> hits;
+    std::atomic<size_t> misses{0}, evictions{0};
+};
+
+#endif  // REGEX_CACHE_HPP
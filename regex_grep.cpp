@@ -0,0 +1,57 @@
+#include<iostream>
+#include<string>
+#include"grep.hpp"
+
+// regex-grep: prints the lines of the given files that contain a match of
+// the pattern. Files are memory-mapped and scanned in parallel chunks (see
+// Grep); the output keeps the order of the input.
+//
+// usage: regex_grep [-c] [-n] [-j threads] pattern file...
+//   -c  print the number of matching lines per file only
+//   -n  prefix every line with its line number
+//   -j  number of worker threads (default: one per hardware thread)
+// Exit status: 0 if some line matched, 1 if none did, 2 on error.
+
+int main(int argc, char **argv){
+    GrepOptions options;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++){
+        std::string flag = argv[arg];
+        if (flag == "-c") options.count_only = true;
+        else if (flag == "-n") options.line_numbers = true;
+        else if (flag == "-j" && arg + 1 < argc) options.threads = std::stoul(argv[++arg]);
+        else{
+            std::cerr << "regex_grep: unknown option " << flag << "\n";
+            return 2;
+        }
+    }
+    if (argc - arg < 2){
+        std::cerr << "usage: regex_grep [-c] [-n] [-j threads] pattern file...\n";
+        return 2;
+    }
+
+    std::ios::sync_with_stdio(false);
+    size_t matched = 0;
+    bool failed = false;
+    try{
+        Grep grep(argv[arg], options);
+        bool label = argc - arg > 2;
+        for (int f = arg + 1; f < argc; f++){
+            try{
+                MappedFile file(argv[f]);
+                matched += grep.scan(file.data(), std::cout, label ? argv[f] : "");
+            }catch (const std::exception &e){
+                std::cerr << "regex_grep: " << e.what() << "\n";
+                failed = true;
+            }
+        }
+    }catch (const std::exception &e){
+        std::cerr << "regex_grep: " << e.what() << "\n";
+        return 2;
+    }
+    std::cout.flush();
+    return failed ? 2 : (matched > 0 ? 0 : 1);
+}
+
+// compile:
+// g++ -std=c++20 -O2 -pthread regex_grep.cpp grep.cpp regex.cpp tokenizer.cpp parser.cpp ast_rewriter.cpp nfa_builder.cpp nfa_optimizer.cpp pike_vm.cpp lazy_dfa.cpp byte_classes.cpp prefilter.cpp aho_corasick.cpp backtrack.cpp onepass.cpp shared_dfa.cpp -o regex_grep
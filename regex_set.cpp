@@ -0,0 +1,87 @@
+#include "regex_set.hpp"
+
+// Checks each pattern as Regex does, then the set as a whole: its program is
+// the programs of all patterns plus a SPLIT per pattern but the last, and
+// there is no reverse program. Nothing is built for a set that fails.
+std::vector<Ast> RegexSet::parse(const std::vector<std::string> &patterns, size_t cache_budget,
+                                 const CompileLimits &limits){
+    if (cache_budget > limits.max_dfa_cache){
+        throw CompileError(CompileError::Kind::DFA_CACHE, cache_budget, limits.max_dfa_cache);
+    }
+    std::vector<Ast> asts;
+    asts.reserve(patterns.size());
+    size_t states = patterns.size() > 1 ? patterns.size() - 1 : 0;
+    size_t memory = states * sizeof(State);
+    for (size_t i = 0; i < patterns.size(); i++){
+        try{
+            asts.push_back(Parser::parse(patterns[i], limits.max_depth));
+        }catch (const CompileError &){
+            throw;
+        }catch (const std::exception &e){
+            throw std::runtime_error("pattern " + std::to_string(i) + " (" + patterns[i] + "): " + e.what());
+        }
+        NfaBuilder::Estimate size = NfaBuilder::estimate(asts.back());
+        if (size.depth > limits.max_depth) throw CompileError(CompileError::Kind::DEPTH, size.depth, limits.max_depth);
+        // Estimates saturate far below SIZE_MAX and the sums stop at the
+        // first one over a limit, so they cannot wrap
+        states += size.states;
+        memory += size.memory();
+        if (states > limits.max_states) throw CompileError(CompileError::Kind::STATES, states, limits.max_states);
+        if (memory > limits.max_memory) throw CompileError(CompileError::Kind::MEMORY, memory, limits.max_memory);
+    }
+    return asts;
+}
+
+RegexSet::RegexSet(const std::vector<std::string> &patterns, size_t cache_budget, const CompileLimits &limits)
+    : RegexSet(parse(patterns, cache_budget, limits), cache_budget) {}
+
+RegexSet::RegexSet(const std::vector<Ast> &asts, size_t cache_budget)
+    : count(asts.size()), prog(NfaBuilder().build_set(asts)), dfa(prog, cache_budget){
+    // Use Aho-Corasick if every pattern is a set of literals
+    std::vector<std::string> all, alternatives;
+    for (size_t i = 0; i < asts.size(); i++){
+        if (!AhoCorasick::literal_alternatives(asts[i], alternatives)) return;
+        all.insert(all.end(), alternatives.begin(), alternatives.end());
+        owner.insert(owner.end(), alternatives.size(), i);
+    }
+    if (all.empty()) return;
+    literals = std::make_unique<AhoCorasick>(all);
+    seen.assign(all.size(), false);
+}
+
+std::vector<size_t> RegexSet::matches(std::string_view input){
+    std::vector<size_t> out;
+    matches(input, out);
+    return out;
+}
+
+void RegexSet::matches(std::string_view input, std::vector<size_t> &out){
+    if (!literals){
+        dfa.which_match(input, out);
+        return;
+    }
+    out.clear();
+    hits.clear();
+    literals->which_occur(input, seen, hits);
+    for (uint32_t lit : hits){
+        seen[lit] = false;
+        out.push_back(owner[lit]);
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// A leftmost-first search over the united program stops at the first match of
+// any pattern, and can use the prefilter
+bool RegexSet::is_match(std::string_view input){
+    if (literals) return literals->find(input, nullptr, &prog.prefilter);
+    return dfa.is_match(input);
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = total number of NFA states over all patterns
+
+// matches() / is_match():
+// O(n) for literal sets (see AhoCorasick); otherwise O(n) with a warm DFA
+// cache, O(n * m) in the worst case (see LazyDfa)
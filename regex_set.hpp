@@ -0,0 +1,55 @@
+#ifndef REGEX_SET_HPP
+#define REGEX_SET_HPP
+#include "nfa_builder.hpp"
+#include "lazy_dfa.hpp"
+#include "aho_corasick.hpp"
+
+// Many patterns compiled into a single automaton.
+// The patterns are united into one NFA program (NfaBuilder::build_set) whose
+// MATCH states carry the index of their pattern, and a lazy DFA over that
+// program reports every matching pattern in one pass over the input, so the
+// cost per input no longer grows with the number of patterns once the DFA
+// cache is warm. Sets made only of literal patterns (foo|bar, baz) run on an
+// Aho-Corasick automaton instead.
+class RegexSet
+{
+public:
+    // Throws std::runtime_error naming the first pattern that does not compile,
+    // and CompileError if a pattern, or the set as a whole, is over 'limits'
+    explicit RegexSet(const std::vector<std::string> &patterns,
+                      size_t cache_budget = LazyDfa::DEFAULT_CACHE_BUDGET, const CompileLimits &limits = {});
+
+    // Indices of the patterns that match somewhere in the input, in increasing order
+    std::vector<size_t> matches(std::string_view input);
+    void matches(std::string_view input, std::vector<size_t> &out);
+
+    // True if at least one pattern matches
+    bool is_match(std::string_view input);
+
+    size_t size() const { return count; }
+
+    // True if the set is routed to Aho-Corasick
+    bool is_literal() const { return literals != nullptr; }
+
+    // The DFA refers to the program, so a set stays where it was built
+    RegexSet(const RegexSet &) = delete;
+    RegexSet &operator=(const RegexSet &) = delete;
+
+private:
+    RegexSet(const std::vector<Ast> &asts, size_t cache_budget);
+    static std::vector<Ast> parse(const std::vector<std::string> &patterns, size_t cache_budget,
+                                  const CompileLimits &limits);
+
+    size_t count;
+    Program prog;
+    LazyDfa dfa;
+
+    // Literal sets: the automaton, the pattern of each of its literals and
+    // scratch for which_occur()
+    std::unique_ptr<AhoCorasick> literals;
+    std::vector<size_t> owner;
+    std::vector<bool> seen;
+    std::vector<uint32_t> hits;
+};
+
+#endif  // REGEX_SET_HPP
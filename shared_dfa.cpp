@@ -0,0 +1,326 @@
+#include "shared_dfa.hpp"
+
+size_t SharedDfa::KeyHash::operator()(const Key &k) const{
+    // FNV-1a over the list entries
+    size_t h = 14695981039346656037ULL;
+    for (uint32_t v : k){
+        h ^= v;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Same estimate as LazyDfa, plus the per-state flags
+size_t SharedDfa::state_cost(size_t len) const{
+    return stride * sizeof(int) + sizeof(uint32_t) * len + sizeof(Info) + 64;
+}
+
+SharedDfa::SharedDfa(const Program &p, size_t cache_budget)
+    : prog(p), classes(p.byte_classes), stride(p.byte_classes.count), budget(cache_budget){
+    // The dead state: every transition leads back to it
+    static const Key dead_key{MODE_FULL};
+    // Every state costs at least state_cost(0)
+    capacity = std::min<size_t>(budget / state_cost(0), std::numeric_limits<int>::max()) + 1;
+    trans = std::allocator<std::atomic<int>>().allocate(capacity * stride);
+    infos = std::allocator<Info>().allocate(capacity);
+    Info *dead = new (&infos[DEAD]) Info;
+    dead->key = &dead_key;
+    dead->eof_match.store(0, std::memory_order_relaxed);
+    for (size_t c = 0; c < stride; c++) new (&trans[c]) std::atomic<int>(DEAD);
+    memory_used = state_cost(0);
+    count.store(1, std::memory_order_release);
+}
+
+// Rows and flags are trivially destructible
+SharedDfa::~SharedDfa(){
+    std::allocator<std::atomic<int>>().deallocate(trans, capacity * stride);
+    std::allocator<Info>().deallocate(infos, capacity);
+}
+
+size_t SharedDfa::memory_usage() const{
+    std::lock_guard<std::mutex> lock(mutex);
+    // memory_used counts a row per state, which the reservation already holds
+    size_t rows = count.load(std::memory_order_relaxed) * stride * sizeof(int);
+    return capacity * (stride * sizeof(std::atomic<int>) + sizeof(Info)) + memory_used - rows;
+}
+
+void SharedDfa::next_stamp(Scratch &scratch) const{
+    if (scratch.visited.size() < prog.size()){
+        scratch.visited.assign(prog.size(), 0);
+        scratch.stamp = 0;
+    }
+    if (++scratch.stamp == 0){
+        std::fill(scratch.visited.begin(), scratch.visited.end(), 0);
+        scratch.stamp = 1;
+    }
+}
+
+// Same as LazyDfa::closure, on the caller's scratch
+void SharedDfa::closure(Key &list, StateId s, bool at_start, bool at_end, Scratch &scratch) const{
+    std::vector<uint32_t> &visited = scratch.visited;
+    std::vector<StateId> &stack = scratch.stack;
+    const uint32_t stamp = scratch.stamp;
+    stack.push_back(s);
+    while (!stack.empty()){
+        StateId id = stack.back();
+        stack.pop_back();
+        while (id != NO_STATE && visited[id] != stamp){
+            visited[id] = stamp;
+            const State &curr = prog[id];
+            switch (curr.type){
+            case StateType::SPLIT:
+                if (curr.out1 != NO_STATE) stack.push_back(curr.out1);
+                id = curr.out;
+                break;
+            case StateType::SAVE:
+                id = curr.out;
+                break;
+            case StateType::ANCHOR_START:
+                id = at_start ? curr.out : NO_STATE;
+                break;
+            case StateType::ANCHOR_END:
+                if (at_end){
+                    id = curr.out;
+                }else{
+                    list.push_back(id);
+                    id = NO_STATE;
+                }
+                break;
+            default:    // CHAR, DOT, CHAR_CLASS, MATCH
+                list.push_back(id);
+                id = NO_STATE;
+                break;
+            }
+        }
+    }
+}
+
+// Called with 'mutex' held. Returns the id of the state with the given key,
+// creating it if it fits in the budget, or GAVE_UP.
+int SharedDfa::add_state(Key key) const{
+    if (key.size() == 1) return DEAD;
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second;
+    if (memory_used + state_cost(key.size()) > budget){
+        full.store(true, std::memory_order_relaxed);
+        return GAVE_UP;
+    }
+
+    // The budget check above keeps 'n' below 'capacity'
+    size_t n = count.load(std::memory_order_relaxed);
+
+    bool has_match = false;
+    for (size_t k = 1; k < key.size(); k++){
+        if (key[k] != RESTART && prog[key[k]].type == StateType::MATCH){
+            has_match = true;
+            break;
+        }
+    }
+    int id = static_cast<int>(n);
+    auto inserted = cache.emplace(std::move(key), id).first;
+    Info *i = new (&infos[n]) Info;
+    i->key = &inserted->first;
+    i->is_match = has_match;
+    std::atomic<int> *r = row(id);
+    for (size_t c = 0; c < stride; c++) new (&r[c]) std::atomic<int>(UNKNOWN);
+    memory_used += state_cost(inserted->first.size());
+    count.store(n + 1, std::memory_order_relaxed);
+    return id;
+}
+
+int SharedDfa::start_state(uint32_t mode, Scratch &scratch) const{
+    int id = start_ids[mode].load(std::memory_order_acquire);
+    if (id != UNKNOWN) return id;
+
+    Key key{mode == MODE_FULL_MID ? MODE_FULL : mode};
+    next_stamp(scratch);
+    closure(key, prog.start, mode != MODE_FULL_MID, false, scratch);
+    if (mode == MODE_SEARCH) key.push_back(RESTART);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    id = add_state(std::move(key));
+    if (id != GAVE_UP) start_ids[mode].store(id, std::memory_order_release);
+    return id;
+}
+
+// The transition of 'from' on 'byte', built if no thread has built it yet
+inline int SharedDfa::next_state(int from, unsigned char byte, Scratch &scratch) const{
+    int next = row(from)[classes[byte]].load(std::memory_order_acquire);
+    return next == UNKNOWN ? transition(from, byte, scratch) : next;
+}
+
+// Same subset step as LazyDfa::transition, built without the lock. The key
+// of 'from' is immutable once the state is published.
+int SharedDfa::transition(int from, unsigned char byte, Scratch &scratch) const{
+    const Key &curr = *info(from).key;
+    uint32_t mode = curr[0];
+    char c = static_cast<char>(byte);
+
+    Key next{mode};
+    next_stamp(scratch);
+    for (size_t k = 1; k < curr.size(); k++){
+        if (curr[k] == RESTART){
+            closure(next, prog.start, false, false, scratch);
+            next.push_back(RESTART);
+            continue;
+        }
+        const State &s = prog[curr[k]];
+        if (s.type == StateType::MATCH){
+            if (mode == MODE_SEARCH) break;
+            continue;
+        }
+        if (prog.accepts(s, c)) closure(next, s.out, false, false, scratch);
+    }
+    if (mode == MODE_SEARCH){
+        for (size_t k = 1; k < next.size(); k++){
+            if (next[k] != RESTART && prog[next[k]].type == StateType::MATCH){
+                next.resize(k + 1);
+                break;
+            }
+        }
+    }
+
+    // A full cache is recorded in the slot too, so later searches give up
+    // right away instead of rebuilding the state
+    std::lock_guard<std::mutex> lock(mutex);
+    int to = add_state(std::move(next));
+    row(from)[classes[byte]].store(to, std::memory_order_release);
+    return to;
+}
+
+// Racing threads compute the same answer, so a relaxed store is enough
+bool SharedDfa::eof_match(int id, bool at_start, Scratch &scratch) const{
+    const Info &d = info(id);
+    if (!at_start){
+        int8_t known = d.eof_match.load(std::memory_order_relaxed);
+        if (known >= 0) return known;
+    }
+
+    const Key &key = *d.key;
+    Key list;
+    next_stamp(scratch);
+    for (size_t k = 1; k < key.size(); k++){
+        closure(list, key[k] == RESTART ? prog.start : key[k], at_start, true, scratch);
+    }
+    bool result = false;
+    for (uint32_t idx : list){
+        if (prog[idx].type == StateType::MATCH){
+            result = true;
+            break;
+        }
+    }
+    if (!at_start) d.eof_match.store(result, std::memory_order_relaxed);
+    return result;
+}
+
+// The loops below are those of LazyDfa, reading the shared table. The
+// prefilter check is a single comparison with a state id (UNKNOWN, which no
+// state has, when there is no prefilter) so that it stays predictable on
+// input that keeps returning to the start state.
+int SharedDfa::is_match(std::string_view input, Scratch &scratch) const{
+    if (!prog.prefilter.may_match(input)) return 0;
+    const int start = start_state(MODE_SEARCH, scratch);
+    if (start == GAVE_UP) return -1;
+    int s = start;
+    if (info(s).is_match) return 1;
+    const Prefilter &pre = prog.prefilter;
+    const int skip_at = pre.is_active() ? start : UNKNOWN;
+
+    for (size_t i = 0; i < input.size(); i++){
+        if (s == skip_at){
+            i = pre.find(input, i);
+            if (i == std::string_view::npos) return 0;
+        }
+        s = next_state(s, static_cast<unsigned char>(input[i]), scratch);
+        if (s == GAVE_UP) return -1;
+        if (info(s).is_match) return 1;
+        if (s == DEAD) return 0;
+    }
+    return eof_match(s, input.empty(), scratch) ? 1 : 0;
+}
+
+size_t SharedDfa::find_end(std::string_view input, Scratch &scratch) const{
+    const size_t npos = std::string_view::npos;
+    if (!prog.prefilter.may_match(input)) return npos;
+    const int start = start_state(MODE_SEARCH, scratch);
+    if (start == GAVE_UP) return CACHE_FULL;
+    int s = start;
+    size_t end = info(s).is_match ? 0 : npos;
+    const Prefilter &pre = prog.prefilter;
+    const int skip_at = pre.is_active() ? start : UNKNOWN;
+
+    for (size_t i = 0; i < input.size(); i++){
+        if (s == skip_at){
+            i = pre.find(input, i);
+            if (i == npos) return npos;
+        }
+        s = next_state(s, static_cast<unsigned char>(input[i]), scratch);
+        if (s == GAVE_UP) return CACHE_FULL;
+        if (s == DEAD) return end;
+        if (info(s).is_match) end = i + 1;
+    }
+    if (eof_match(s, input.empty(), scratch)) end = input.size();
+    return end;
+}
+
+size_t SharedDfa::find_start(std::string_view input, size_t end, Scratch &scratch) const{
+    int s = start_state(end == input.size() ? MODE_FULL : MODE_FULL_MID, scratch);
+    if (s == GAVE_UP) return CACHE_FULL;
+    size_t start = info(s).is_match ? end : std::string_view::npos;
+
+    for (size_t i = end; i > 0; i--){
+        s = next_state(s, static_cast<unsigned char>(input[i - 1]), scratch);
+        if (s == GAVE_UP) return CACHE_FULL;
+        if (s == DEAD) return start;
+        if (info(s).is_match) start = i - 1;
+    }
+    if (eof_match(s, input.empty(), scratch)) start = 0;
+    return start;
+}
+
+int SharedDfa::ends_at(std::string_view input, size_t end, size_t &limit, Scratch &scratch) const{
+    int s = start_state(end == input.size() ? MODE_FULL : MODE_FULL_MID, scratch);
+    if (s == GAVE_UP) return -1;
+    if (info(s).is_match) return 1;
+
+    for (size_t i = end; i > 0; i--){
+        if (limit == 0) return -1;
+        limit--;
+        s = next_state(s, static_cast<unsigned char>(input[i - 1]), scratch);
+        if (s == GAVE_UP) return -1;
+        if (info(s).is_match) return 1;
+        if (s == DEAD) return 0;
+    }
+    return eof_match(s, input.empty(), scratch) ? 1 : 0;
+}
+
+int SharedDfa::full_match(std::string_view input, Scratch &scratch) const{
+    if (!prog.prefilter.may_match(input)) return 0;
+    int s = start_state(MODE_FULL, scratch);
+    if (s == GAVE_UP) return -1;
+
+    for (size_t i = 0; i < input.size(); i++){
+        s = next_state(s, static_cast<unsigned char>(input[i]), scratch);
+        if (s == GAVE_UP) return -1;
+        if (s == DEAD) return 0;
+    }
+    return eof_match(s, input.empty(), scratch) ? 1 : 0;
+}
+
+// Time Complexity Analysis:
+
+// n = input length, m = number of NFA states, t = number of threads
+
+// Reads:
+// One atomic load per byte for the slot plus the flags of the target, the
+// same table walk as LazyDfa → O(1) per byte with a warm cache, with no lock
+// and no write to shared memory
+
+// transition():
+// O(m) for the subset step, without the lock, then O(|key|) to hash the list
+// under the lock. Each state is built at most t times (once per thread that
+// raced for it) and stored once, so warm-up is paid once per pattern rather
+// than once per thread.
+
+// Memory:
+// At most the budget for all threads together, instead of one budget each
@@ -0,0 +1,124 @@
+#ifndef SHARED_DFA_HPP
+#define SHARED_DFA_HPP
+#include "nfa.hpp"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+// Lazy DFA whose state cache is shared by every thread that searches with it,
+// so the states of a hot pattern are built once rather than once per thread.
+//
+// Same subset construction as LazyDfa, with a cache that readers never lock:
+// - transition slots are atomics; a slot is filled with a release store once
+//   its target state is complete, so a thread that reads the id (acquire)
+//   also sees the target's row and flags
+// - states are append-only and never move: the table is reserved up front for
+//   as many states as the budget can hold (address space only; a row is
+//   constructed, and its memory touched, when its state is added), so it never
+//   reallocates under a reader and a state's id stays valid for the life of
+//   the DFA
+// - building a new state (the subset construction itself) runs on the
+//   caller's Scratch without any lock; only adding it to the cache takes the
+//   mutex, and two threads that built the same state end up with the same id
+//
+// Since readers may hold any id, the cache can never be flushed. Once it
+// reaches its memory budget no state is added anymore: a search that needs a
+// missing state reports that the cache is full, and the caller answers with
+// its own engine (see Regex, which falls back to the per-thread LazyDfa).
+//
+// Only the leftmost-first searches are supported (no sets, no streams).
+class SharedDfa
+{
+public:
+    static constexpr size_t DEFAULT_CACHE_BUDGET = 8 * 1024 * 1024;
+
+    // Returned by find_end() and find_start() when the cache is full
+    static constexpr size_t CACHE_FULL = std::numeric_limits<size_t>::max() - 1;
+
+    // Per-thread scratch for the subset construction; reusable across calls
+    // and across SharedDfas
+    class Scratch
+    {
+    private:
+        friend class SharedDfa;
+        std::vector<uint32_t> visited;  // stamp per NFA state
+        uint32_t stamp = 0;
+        std::vector<StateId> stack;
+    };
+
+    // The program is only read; it must outlive the DFA. Like LazyDfa's, it
+    // must have no counted loops.
+    explicit SharedDfa(const Program &prog, size_t cache_budget = DEFAULT_CACHE_BUDGET);
+
+    ~SharedDfa();
+
+    SharedDfa(const SharedDfa &) = delete;
+    SharedDfa &operator=(const SharedDfa &) = delete;
+
+    // Same answers as the LazyDfa functions of the same name. Any number of
+    // threads may search at once, each with its own Scratch.
+    // is_match(), full_match() and ends_at() return 1 (yes), 0 (no) or -1 if
+    // the cache is full; ends_at() also returns -1 when 'limit' runs out.
+    int is_match(std::string_view input, Scratch &scratch) const;
+    int full_match(std::string_view input, Scratch &scratch) const;
+    size_t find_end(std::string_view input, Scratch &scratch) const;
+    size_t find_start(std::string_view input, size_t end, Scratch &scratch) const;
+    int ends_at(std::string_view input, size_t end, size_t &limit, Scratch &scratch) const;
+
+    size_t num_states() const { return count.load(std::memory_order_relaxed); }
+    // Bytes held: the tables reserved for every state the budget allows,
+    // whether or not they are in use yet, and the keys of the states added
+    size_t memory_usage() const;
+    bool is_full() const { return full.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int DEAD = 0;
+    static constexpr int UNKNOWN = -1;
+    static constexpr int GAVE_UP = -2;     // cache full
+    static constexpr uint32_t RESTART = std::numeric_limits<uint32_t>::max();
+
+    static constexpr uint32_t MODE_SEARCH = 0;
+    static constexpr uint32_t MODE_FULL = 1;
+    static constexpr uint32_t MODE_FULL_MID = 2;    // start state only, '^' does not hold
+
+    using Key = std::vector<uint32_t>;
+    struct KeyHash {
+        size_t operator()(const Key &k) const;
+    };
+
+    struct Info {
+        const Key *key = nullptr;   // points into 'cache'
+        bool is_match = false;
+        mutable std::atomic<int8_t> eof_match{-1};  // -1 = not computed, 0 = no, 1 = yes
+    };
+
+    std::atomic<int> *row(int id) const { return trans + static_cast<size_t>(id) * stride; }
+    const Info &info(int id) const { return infos[id]; }
+
+    size_t state_cost(size_t len) const;
+    int start_state(uint32_t mode, Scratch &scratch) const;
+    int next_state(int from, unsigned char byte, Scratch &scratch) const;
+    int transition(int from, unsigned char byte, Scratch &scratch) const;
+    int add_state(Key key) const;
+    bool eof_match(int id, bool at_start, Scratch &scratch) const;
+    void closure(Key &list, StateId s, bool at_start, bool at_end, Scratch &scratch) const;
+    void next_stamp(Scratch &scratch) const;
+
+    const Program &prog;
+    ByteClasses classes;
+    size_t stride;
+    size_t budget;
+
+    // Written under 'mutex' only; read without it through published ids
+    mutable std::mutex mutex;
+    mutable std::unordered_map<Key, int, KeyHash> cache;
+    size_t capacity;            // states the budget can hold at most
+    std::atomic<int> *trans;    // 'stride' slots per state, 'capacity' states
+    Info *infos;
+    mutable size_t memory_used = 0;
+    mutable std::atomic<size_t> count{0};
+    mutable std::atomic<bool> full{false};
+    mutable std::atomic<int> start_ids[3] = {UNKNOWN, UNKNOWN, UNKNOWN};
+};
+
+#endif  // SHARED_DFA_HPP
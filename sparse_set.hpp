@@ -0,0 +1,49 @@
+#ifndef SPARSE_SET_HPP
+#define SPARSE_SET_HPP
+#include "std.hpp"
+
+// Set of integers in [0, capacity) with O(1) insert, lookup and clear
+// (Briggs & Torczon). Iteration order is insertion order.
+class SparseSet
+{
+public:
+    explicit SparseSet(size_t capacity = 0) : dense(capacity), sparse(capacity) {}
+
+    void resize(size_t capacity){
+        dense.assign(capacity, 0);
+        sparse.assign(capacity, 0);
+        len = 0;
+    }
+
+    // Makes room for integers up to capacity - 1, keeping the contents
+    void grow(size_t capacity){
+        dense.resize(capacity);
+        sparse.resize(capacity);
+    }
+
+    bool contains(uint32_t v) const{
+        uint32_t i = sparse[v];
+        return i < len && dense[i] == v;
+    }
+
+    // Returns false if 'v' was already in the set
+    bool insert(uint32_t v){
+        if (contains(v)) return false;
+        dense[len] = v;
+        sparse[v] = static_cast<uint32_t>(len);
+        len++;
+        return true;
+    }
+
+    void clear() { len = 0; }
+    size_t size() const { return len; }
+    size_t capacity() const { return dense.size(); }
+    uint32_t operator[](size_t i) const { return dense[i]; }
+
+private:
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> sparse;
+    size_t len = 0;
+};
+
+#endif  // SPARSE_SET_HPP
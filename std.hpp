@@ -20,5 +20,6 @@
 #include<unordered_set>
 #include<fstream>
 #include<cstdlib>
+#include<limits>
 
 #endif  // STD_HPP
\ No newline at end of file
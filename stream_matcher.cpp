@@ -0,0 +1,34 @@
+#include "stream_matcher.hpp"
+#include "nfa_builder.hpp"
+
+StreamMatcher::StreamMatcher(const Program &prog, size_t cache_budget)
+    : expanded(prog.counters.empty() ? Program() : NfaBuilder::expand(prog)),
+      dfa(prog.counters.empty() ? prog : expanded, cache_budget){
+    dfa.begin(scan);
+}
+
+void StreamMatcher::feed(std::string_view chunk){
+    if (finished) throw std::runtime_error("stream is already finished");
+    dfa.feed(scan, chunk);
+}
+
+void StreamMatcher::finish(){
+    if (finished) return;
+    dfa.finish(scan);
+    finished = true;
+}
+
+void StreamMatcher::reset(){
+    dfa.begin(scan);
+    finished = false;
+}
+
+// Time Complexity Analysis:
+
+// n = total stream length, m = number of NFA states
+
+// feed():
+// O(1) per byte with a warm cache, O(m) for a byte that takes an uncached
+// transition → O(n * m) worst case over the stream, O(n) with a warm cache.
+// Once the match end is settled the remaining chunks are only counted.
+// Memory: the DFA cache budget, independent of n
@@ -0,0 +1,52 @@
+#ifndef STREAM_MATCHER_HPP
+#define STREAM_MATCHER_HPP
+#include "lazy_dfa.hpp"
+
+// Searches a stream that arrives in chunks (network buffers, rotating log
+// files) for the leftmost-first match of a pattern, without copying or
+// concatenating the chunks.
+// The lazy DFA state is carried from one chunk to the next, so a match that
+// spans chunk boundaries is found exactly as if the stream were one string,
+// and memory stays bounded by the DFA's cache budget whatever the stream
+// length. Offsets are absolute, counted from the first byte of the stream.
+//
+// Only the end of the match is reported: its start may lie in chunks that
+// are gone. The program is only read; it must outlive the matcher. A program
+// with counted loops is expanded for the DFA (see NfaBuilder::expand).
+class StreamMatcher
+{
+public:
+    explicit StreamMatcher(const Program &prog, size_t cache_budget = LazyDfa::DEFAULT_CACHE_BUDGET);
+
+    // Scans the next chunk; the chunk is not retained.
+    // Throws std::runtime_error after finish().
+    void feed(std::string_view chunk);
+
+    // Ends the stream ('$' matches here)
+    void finish();
+
+    // A match has been seen; its end may still move until done()
+    bool matched() const { return scan.end != std::string_view::npos; }
+
+    // No further input can change the result
+    bool done() const { return scan.settled; }
+
+    // Offset one past the end of the leftmost-first match (the end
+    // PikeVM::search reports for the whole stream), or std::string_view::npos
+    // if there is none yet. Final once done().
+    size_t match_end() const { return scan.end; }
+
+    // Bytes fed so far
+    size_t offset() const { return scan.offset; }
+
+    // Starts a new stream; the DFA cache is kept
+    void reset();
+
+private:
+    Program expanded;   // empty unless the program has counted loops
+    LazyDfa dfa;
+    LazyDfa::Scan scan;
+    bool finished = false;
+};
+
+#endif  // STREAM_MATCHER_HPP
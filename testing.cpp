@@ -3,149 +3,26 @@
 #include"tokenizer.hpp"
 #include"postfix.hpp"
 #include"nfa_builder.hpp"
+#include"pike_vm.hpp"
+#include"lazy_dfa.hpp"
+#include"dfa.hpp"
+#include"regex_set.hpp"
+#include"regex.hpp"
+#include"backtrack.hpp"
+#include"stream_matcher.hpp"
+#include"regex_cache.hpp"
+#include"grep.hpp"
+#include"test_patterns.hpp"
 #include<chrono>
+#include<thread>
+#include<filesystem>
+#include<cstring>
+#include<sstream>
+#include<fstream>
 using namespace std;
 
 int main(){
-    // Test Set:
-    std::vector<std::string> tcs = {
-        // Basics
-        "a","ab","abc","aaaa","b","."," ",
-
-        // Alternation
-        "a|b","ab|cd","a|b|c","(a|b)c","a(b|c)d","a|b|c|d|e",
-
-        // Grouping
-        "(a)","(ab)","(a|b)","((a))","(a(b(c)))","((((a))))","(a)|(b)","(a(b)c)",
-
-        // Star / Plus / Optional
-        "a*","(ab)*","(a|b)*","((ab)*)*","(a*)*",
-        "a+","(ab)+","(a|b)+",
-        "a?","(ab)?","(a|b)?",
-        "()+", // -> runtime error (empty parentheses) (correct by design)
-        "a**", // -> runtime error (quantifier follow invalid token) (correct)
-
-        // Mixed Quantifiers
-        "a*b+","a+b*","a?b+","(a|b)*c","(a|b)+c",
-
-        // Ranges
-        "a{0}","a{1}","a{2}","a{3}",
-        "a{0,1}","a{1,2}","a{2,4}","a{3,5}","a{1,}","a{0,}",
-        "(ab){2}","(a|b){2,4}","(abc){2,3}","[a-z]{2,5}",
-
-        // Char classes
-        "[a]","[abc]","[^abc]","[a-z]","[A-Z0-9]","[a-zA-Z]","[a-zA-Z0-9]",
-
-        // Dot
-        ".*",".+",".{2,4}","(.)*",
-
-        // Anchors
-        "^a","a$","^a$","^abc$","^(a|b)*$","^a|b$","^.*$",
-
-        // Captures
-        "(a)","(a)(b)","((a)b)","(a(b(c)))","(a|b)c(d|e)",
-
-        // Pathological nesting
-        "((((a)))*|b)+","((a|b)*)*","((a*)*)*","(((ab)*)*)*","((a|ab)*)*",
-
-        // Precedence
-        "a|bc","ab|c","a(b|c)d","(a|b)(c|d)","a|b*","(a|b)*","a(b*)","(ab)*c",
-
-        // Overlapping
-        "a|aa","(a|aa)*","(a|ab)*","(ab|a)*",
-
-        // Epsilon-heavy
-        "a*?", // -> runtime error (does not support lazy quantifiers as of now)
-        "(a?)*","(a*)?","((a?)*)*",
-
-        // Large
-        "abcdefghij","(abc){10}","((ab)c){5}",
-
-        // Escapes
-        "a\\.b","\\\\\\*","a\\{2\\}","a b",
-
-        // Special / Edge
-        "",
-        "(a(b)", // -> runtime error (missing parentheses) (correct)
-        "[a-z" , // -> runtime error (unterminated char class) (correct)
-        "a{2,1}" // -> runtime error (invalid range) (correct)
-
-        // CHAR CLASS TESTS: (These tests mostly test the tokenizer because the NFA is lite)
-        // Basic valid classes
-        "[a]", "[z]", "[0]", "[_]", "[9]",
-        "[abc]", "[xyz]", "[aZ9_]",
-
-        // Simple ranges
-        "[a-z]", "[A-Z]", "[0-9]",
-
-        // Multiple ranges
-        "[a-zA-Z]", "[a-z0-9]", "[A-Fa-f0-9]",
-        "[a-zA-Z0-9_]", "[A-Za-z_]", "[0-9A-Fa-f]",
-
-        // Mixed range + literal
-        "[a-z_]", "[_a-z]", "[a-z9]", "[0-9a-f]",
-
-        // Negated classes
-        "[^a]", "[^abc]", "[^a-z]", "[^a-zA-Z0-9_]",
-        "[^\\w\\s\\d]", "[^-]", "[^\\d]", "[^\\d-]", "[^]]",
-
-        // Escaped characters
-        "[\\]]", "[\\[]", "[\\-]", "[\\\\]", "[\\^]",
-        "[\\.]", "[\\{]", "[\\}]", "[\\(]", "[\\)]",
-
-        // Escaped + normal mix
-        "[a\\-z]", "[a\\]z]", "[\\-a-z]", "[a\\[b\\]c]",
-        "[a\\]b]", "[a\\]]", "[a\\-\\]]",
-
-        // Hyphen handling
-        "[-]", "[--]", "[a-]", "[-a]", "[a-b]", "[--a]",
-        "[a-b-c]", "[a--c]", "[a\\--c]", "[\\--\\-]",
-
-        // ASCII / table spans
-        "[ -/]", "[A-z]", "[!-~]",
-
-        // Empty / malformed
-        "[]", "[^]", "[", "[a", "[^a", "[a-z", "[\\]", "[]]", "[]-a]",
-
-        // Invalid ranges
-        "[z-a]", "[9-0]", "[Z-A]", "[a--b]",
-
-        // Nested / weird
-        "[[a]]", "[a[b]c]",
-
-        // Shorthands
-        "[\\d]", "[\\D]", "[\\w]", "[\\W]", "[\\s]", "[\\S]",
-        "[\\d\\d]", "[\\d\\w]", "[\\w\\d]", "[\\s\\d]",
-        "[\\d-]", "[\\w-]", "[a\\dZ]",
-
-        // Illegal shorthand ranges
-        "[\\d-a]", "[a-\\d]", "[\\d-\\w]", "[\\w-\\s]",
-        "[\\s-\\d]", "[^\\d-a]", "[^\\s-\\w]",
-
-        // Boundary / weird negations
-        "[^^]", "[^\\^]", "[^\\[]",
-
-        // Adjacent ranges
-        "[a-bc]", "[ab-c]", "[a-b-c-d]",
-
-        // Escaped range boundaries
-        "[\\[-\\]]",
-
-        // Weird escapes
-        "[\\n]", "[\\t]", "[\\r]", "[\\v]", "[\\f]",
-
-        // Literal metacharacters
-        "[.]", "[(]", "[)]", "[{]", "[}]", "[|]", "[*]", "[+]", "[?]",
-
-        // Overlapping syntax
-        "[a|b]", "[a||b]",
-
-        // Stress
-        "[abcdefghijklmnopqrstuvwxyz]",
-
-        // Weird Quantifiers
-        "{2,3}", "{  4   , 7   }", "{  6   ,  }", "{  ,   10  }", "{    ,  }", "{}", "{   }", "{ 22 , a }", "{  8 ,  2}"
-    };
+    // Test Set: TEST_PATTERNS (test_patterns.hpp)
 
     vector<std::string> weirdQuantifiers = {"{2,3}", "{  4   , 7   }", "{  6   ,  }", "{  ,   10  }", "{    ,  }", "{}", "{   }", "{ 22 , a }", "{  8 ,  2}"};
 
@@ -169,7 +46,7 @@ int main(){
             
             // 3. print nfa: (check results in nfas/)
             // NfaPrinter::print_nfa(nb.build(postfix), i);
-            // State* s = nb.build(postfix);
+            // Program nfa = nb.build(postfix);
         }catch (const std::exception& e) {
             std::cout << "ERR: "  << " -> " << e.what() << "\n";
         }
@@ -177,7 +54,347 @@ int main(){
     auto end = std::chrono::high_resolution_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
     std::cout << "Elapsed time: " << elapsed.count() << " ms\n";
-    return 0;
+
+    // Matching tests: {pattern, input, expected group 0 span (or no match)}
+    struct MatchTc { std::string pattern, input; bool found; size_t from, to; };
+    vector<MatchTc> match_tcs = {
+        {"abc", "xxabcxx", true, 2, 5},
+        {"a|ab", "ab", true, 0, 1},             // leftmost-first, not longest
+        {"(a|ab)(c|bcd)", "abcd", true, 0, 4},
+        {"a*", "bbb", true, 0, 0},
+        {"a+", "bbaaab", true, 2, 5},
+        {"^ab", "cab", false, 0, 0},
+        {"ab$", "abab", true, 2, 4},
+        {"[^a-c]+", "abcxyzc", true, 3, 6},
+        {"a{2,3}", "aaaa", true, 0, 3},
+        {"(ab){2}", "ababab", true, 0, 4},
+        {"x{0}y", "xy", true, 1, 2},
+        {"(a|bc){1,3}d", "abcabcad", true, 3, 8},
+        {"[0-9]{2,}-", "1-22-", true, 2, 5},
+        {"((a*)*)*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaac", false, 0, 0},
+        {".+", "ab\ncd", true, 0, 2},
+        // prefilter: literal prefix, alternatives sharing a prefix, first bytes
+        {"ERROR: (.*)", "ok\nERROR: disk", true, 3, 14},
+        {"abc|abd", "ababd", true, 2, 5},
+        {"(ab|ac)d", "aacd", true, 1, 4},
+        {"[xy]z", "xxyyz", true, 3, 5},
+        {"needle", std::string(40, 'n') + "needle", true, 40, 46},
+        {"needle", std::string(40, 'n') + "needl", false, 0, 0},
+        // required inner literal
+        {"[a-z]+@example\\.com", "to: bob@example.com", true, 4, 19},
+        {"[a-z]+@example\\.com", "to: bob@example.org", false, 0, 0},
+        {"(a|b)(cd){2}", "acdcd", true, 0, 5},
+        // anchors in the middle concatenate like any other atom
+        {".^b", "ab", false, 0, 0},
+        {"a$|b", "ab", true, 1, 2},
+        {"($abc)|ab", "xab", true, 1, 3},
+        {"(a|^)b", "bab", true, 0, 1},
+        {"b$c|c", "bc", true, 1, 2},
+        {"x|^a$", "a", true, 0, 1},
+    };
+    size_t passed = 0;
+    for (const auto& tc : match_tcs){
+        NfaBuilder builder;
+        Program nfa = builder.build(Parser::parse(tc.pattern));
+        PikeVM vm(nfa);
+        LazyDfa dfa(nfa);
+        Backtracker bt(nfa);
+        Dfa full_dfa = Dfa::compile(nfa, false);
+        Captures caps, bt_caps;
+        bool found = vm.search(tc.input, &caps);
+        bool ok = found == tc.found && (!found || (caps[0] == tc.from && caps[1] == tc.to)) &&
+                  bt.search(tc.input, &bt_caps) == found && (!found || bt_caps == caps) &&
+                  dfa.is_match(tc.input) == tc.found && full_dfa.is_match(tc.input) == tc.found;
+        if (ok) passed++;
+        else std::cout << "MATCH FAIL: " << tc.pattern << " on \"" << tc.input << "\"\n";
+    }
+    std::cout << "Matching: " << passed << "/" << match_tcs.size() << " passed\n";
+
+    // Persistence: a serialized DFA, viewed in memory or saved and mapped back,
+    // answers as the compiled one; damaged blobs are refused
+    bool persist_ok = true;
+    for (const auto& tc : match_tcs){
+        Dfa compiled = Dfa::compile(NfaBuilder().build(Parser::parse(tc.pattern)), false);
+        std::vector<char> blob = compiled.serialize();
+        Dfa viewed = Dfa::view(blob.data(), blob.size());
+        persist_ok = persist_ok && viewed.num_states() == compiled.num_states() &&
+                     viewed.is_match(tc.input) == compiled.is_match(tc.input) && viewed.is_match("") == compiled.is_match("");
+    }
+    std::string dfa_path = (std::filesystem::temp_directory_path() / "testing_dfa.bin").string();
+    Dfa anchored_dfa = Dfa::compile(NfaBuilder().build(Parser::parse("[a-z]+@[a-z]+")), true);
+    anchored_dfa.save(dfa_path);
+    {
+        Dfa loaded = Dfa::load(dfa_path);
+        persist_ok = persist_ok && loaded.is_anchored() && loaded.is_match("bob@example") && !loaded.is_match("bob@example.com");
+    }
+    std::filesystem::remove(dfa_path);
+    auto refused = [](std::vector<char> blob){
+        try{
+            Dfa::view(blob.data(), blob.size());
+        }catch (const std::runtime_error &){
+            return true;
+        }
+        return false;
+    };
+    std::vector<char> good = anchored_dfa.serialize();
+    std::vector<char> truncated(good.begin(), good.end() - 1), wrong_version = good, bad_transition = good;
+    wrong_version[7]++;                                     // the format version ends the magic
+    std::memset(bad_transition.data() + 32 + 256, 0xff, 4); // header, byte class map, then the table
+    persist_ok = persist_ok && !refused(good) && refused(truncated) && refused(wrong_version) && refused(bad_transition);
+    std::cout << "Persistence: " << (persist_ok ? "passed" : "FAILED") << "\n";
+
+    // Set tests: every pattern that matches somewhere, in one pass
+    RegexSet set({"err(or)?", "^warn", "[0-9]+ms$", "disk", "a{2}"});
+    struct SetTc { std::string input; std::vector<size_t> expected; };
+    vector<SetTc> set_tcs = {
+        {"warn: disk error", {0, 1, 3}},
+        {"error after 25ms", {0, 2}},
+        {"no warn here", {}},
+        {"aa", {4}},
+        {"", {}},
+    };
+    size_t set_passed = 0;
+    for (const auto& tc : set_tcs){
+        if (set.matches(tc.input) == tc.expected && set.is_match(tc.input) == !tc.expected.empty()) set_passed++;
+        else std::cout << "SET FAIL: \"" << tc.input << "\"\n";
+    }
+    std::cout << "Sets: " << set_passed << "/" << set_tcs.size() << " passed\n";
+
+    // Literal patterns and sets are routed to Aho-Corasick
+    Regex literal("foo|foobar|ba(r|z)");
+    RegexSet literal_set({"foo", "bar|baz", "qux"});
+    Captures literal_caps;
+    bool literal_ok = literal.is_literal() && literal_set.is_literal() &&
+                      literal.search("xfoobar", &literal_caps) && literal_caps[0] == 1 && literal_caps[1] == 4 &&
+                      literal.search("xxbaz") && !literal.is_match("fobaqux") &&
+                      literal_set.matches("bazfoo") == std::vector<size_t>{0, 1} && !literal_set.is_match("fo ba");
+    std::cout << "Literals: " << (literal_ok ? "passed" : "FAILED") << "\n";
+
+    // One-pass patterns resolve captures in a single scan
+    Regex fields("^(\\d+)-(\\d+)$");
+    Regex key_value("^(\\w+)=(\\w*)");
+    Captures field_caps, kv_caps;
+    bool onepass_ok = OnePass::compile(fields.program()) && !OnePass::compile(Regex("(a|ab)c").program()) &&
+                      fields.full_match("12-345", &field_caps) && field_caps == Captures{0, 6, 0, 2, 3, 6} &&
+                      !fields.full_match("12-", &field_caps) &&
+                      key_value.search("k=v w", &kv_caps) && kv_caps == Captures{0, 3, 0, 1, 2, 3};
+    std::cout << "One-pass: " << (onepass_ok ? "passed" : "FAILED") << "\n";
+
+    // Spans come from a forward DFA (end) and a reverse DFA (start)
+    Program reversed = NfaBuilder().build_reverse(Parser::parse("^ab(c|d)+"));
+    LazyDfa reversed_dfa(reversed);
+    Regex email("([a-z]+)@([a-z]+)\\.com");
+    Captures email_caps;
+    bool reverse_ok = reversed_dfa.full_match("dcba") && !reversed_dfa.full_match("abcd") &&
+                      email.search("mail bob@example.com now", &email_caps) &&
+                      email_caps == Captures{5, 20, 5, 8, 9, 16} && !email.search("bob@example.org", &email_caps);
+    std::cout << "Reverse: " << (reverse_ok ? "passed" : "FAILED") << "\n";
+
+    // '$' and literal suffixes are checked backwards from the end
+    Regex json(".*\\.json$");
+    Regex json_word("[a-z]+\\.json");
+    Captures json_caps;
+    bool suffix_ok = json.is_match("cdn/a/b.json") && !json.is_match("a.json/b") &&
+                     json.search("x\nfoo.json", &json_caps) && json_caps == Captures{2, 10} &&
+                     json_word.is_match("1.json x.json2") && !json_word.is_match("1.json .json");
+    std::cout << "Suffix: " << (suffix_ok ? "passed" : "FAILED") << "\n";
+
+    // Streams: matches across chunk boundaries, absolute offsets
+    Regex error_line("ERROR: (.*)");
+    StreamMatcher stream(error_line.program());
+    for (std::string_view chunk : {"ok\nERR", "OR: di", "sk\nnext"}) stream.feed(chunk);
+    stream.finish();
+    Regex tail("abc$");
+    StreamMatcher tail_stream(tail.program());
+    tail_stream.feed("xab");
+    bool tail_early = tail_stream.matched();
+    tail_stream.feed("c");
+    tail_stream.finish();
+    // A cache flushed by a thrashing stretch finds its start state again, so
+    // the prefilter skips the quiet stretch that follows
+    Regex thrash("zq[ab]*a[ab]{7}x");
+    LazyDfa small_dfa(thrash.program(), 16 * 1024);
+    std::string noisy = "zq";
+    for (unsigned i = 0, x = 1; i < 3000; i++, x = x * 1103515245 + 12345) noisy += "ab"[(x >> 16) & 1];
+    LazyDfa::Scan scan;
+    small_dfa.begin(scan);
+    for (const std::string &piece : {noisy, std::string(1000, 'c') + "zqaabababax", std::string(10, 'c')}) small_dfa.feed(scan, piece);
+    small_dfa.finish(scan);
+    bool stream_ok = stream.done() && stream.match_end() == 14 && stream.offset() == 19 && !tail_early &&
+                     tail_stream.match_end() == 4 && small_dfa.num_flushes() > 0 && scan.end == noisy.size() + 1011;
+    std::cout << "Streams: " << (stream_ok ? "passed" : "FAILED") << "\n";
+
+    // Threads: one Regex shared by several threads, each with its own Cache
+    // (or the built-in pool), with per-thread or shared lazy DFA states
+    const Regex per_thread("([a-z]+)=([0-9]+)");
+    const Regex shared("([a-z]+)=([0-9]+)", RegexOptions{true});
+    vector<int> thread_ok(4, 0);
+    vector<std::thread> threads;
+    for (size_t t = 0; t < thread_ok.size(); t++){
+        threads.emplace_back([&per_thread, &shared, &thread_ok, t]{
+            const Regex &re = t < 2 ? per_thread : shared;
+            Regex::Cache cache = re.create_cache();
+            bool ok = true;
+            for (size_t i = 0; i < 1000; i++){
+                std::string line = "id " + std::string(t + 1, 'k') + "=" + std::to_string(i) + ";";
+                Captures caps;
+                ok = ok && (t % 2 ? re.search(line, &caps) : re.search(line, cache, &caps)) &&
+                     caps == Captures{3, 5 + t + std::to_string(i).size(), 3, 4 + t, 5 + t, 5 + t + std::to_string(i).size()} &&
+                     !re.is_match("id =;", cache);
+            }
+            thread_ok[t] = ok;
+        });
+    }
+    for (std::thread &th : threads) th.join();
+    bool threads_ok = std::count(thread_ok.begin(), thread_ok.end(), 1) == 4;
+    std::cout << "Threads: " << (threads_ok ? "passed" : "FAILED") << "\n";
+
+    // Compiled-pattern cache: repeats are hits, the least recently used
+    // pattern is evicted first
+    RegexCache compiled(2 * Regex("[a-z]+@[a-z]+").memory_usage() + 64);
+    auto first = compiled.get("[a-z]+@[a-z]+");
+    bool cache_ok = compiled.get("[a-z]+@[a-z]+") == first && compiled.get("[0-9]+@[0-9]+")->is_match("1@2");
+    compiled.get("[a-z]+@[a-z]+");
+    compiled.get("[a-y]+@[a-y]+");  // evicts [0-9]+@[0-9]+
+    RegexCache::Stats cache_stats = compiled.stats();
+    cache_ok = cache_ok && compiled.get("[a-z]+@[a-z]+") == first && cache_stats.hits == 2 &&
+               cache_stats.misses == 3 && cache_stats.evictions == 1 && cache_stats.entries == 2;
+    // The lazy DFA caches a Regex keeps for later calls count against the budget
+    Regex warmed("[a-z]+@[a-z]+");
+    size_t cold_size = warmed.memory_usage();
+    cache_ok = cache_ok && warmed.is_match("mail bob@example") && warmed.memory_usage() > cold_size &&
+               cache_stats.memory <= 2 * cold_size + 64;
+    // A miss measures the entries after it again, so their growth shows
+    RegexCache sampled;
+    auto grown = sampled.get("[a-z]+@[a-z]+");
+    grown->is_match("mail bob@example");
+    auto other = sampled.get("[0-9]+@[0-9]+");
+    cache_ok = cache_ok && sampled.stats().memory == grown->memory_usage() + other->memory_usage() &&
+               grown->memory_usage() > cold_size;
+    std::cout << "Pattern cache: " << (cache_ok ? "passed" : "FAILED") << "\n";
+
+    // Batches: same answers as is_match, as a bitmap or as indices
+    Regex phone("[0-9]{3}-[0-9]{4}");
+    vector<std::string_view> records = {"call 555-1234", "", "55-1234", "x555-12345", "555-123", "tel:000-0000,"};
+    vector<bool> batch_bits;
+    vector<size_t> batch_indices;
+    phone.match_batch(records, batch_bits);
+    phone.match_batch(records, batch_indices);
+    bool batch_ok = batch_bits == vector<bool>{true, false, false, true, false, true} &&
+                    batch_indices == vector<size_t>{0, 3, 5};
+    std::cout << "Batches: " << (batch_ok ? "passed" : "FAILED") << "\n";
+
+    // Grep: chunks much smaller than the lines, scanned by three threads, give
+    // the lines of a one-thread scan in order and with their numbers, the last
+    // line included without a newline; an empty file has no lines
+    std::string log = "alpha error one\nbeta\nerror in a line longer than a chunk\n\ndelta\nfinal error";
+    auto grep_out = [&](std::string_view data, GrepOptions options){
+        std::ostringstream out;
+        size_t n = Grep("error", options).scan(data, out, options.count_only ? "log" : "");
+        return std::to_string(n) + "|" + out.str();
+    };
+    std::string grep_path = (std::filesystem::temp_directory_path() / "testing_grep.txt").string();
+    std::ofstream(grep_path, std::ios::binary).close();
+    bool grep_ok = grep_out(log, {.threads = 3, .chunk_size = 8, .line_numbers = true}) ==
+                       "3|1:alpha error one\n3:error in a line longer than a chunk\n6:final error\n" &&
+                   grep_out(log, {.threads = 3, .chunk_size = 8}) == grep_out(log, {.threads = 1}) &&
+                   grep_out(log, {.threads = 2, .chunk_size = 5, .count_only = true}) == "3|log:3\n" &&
+                   grep_out(MappedFile(grep_path).data(), {.threads = 2, .line_numbers = true}) == "0|";
+    std::filesystem::remove(grep_path);
+    std::cout << "Grep: " << (grep_ok ? "passed" : "FAILED") << "\n";
+
+    // Limits: patterns over a CompileLimits are turned down with the limit they hit
+    auto rejected_for = [](const std::string &pattern, const RegexOptions &options){
+        try{
+            Regex r(pattern, options);
+        }catch (const CompileError &e){
+            return static_cast<int>(e.kind);
+        }
+        return -1;
+    };
+    RegexOptions strict;
+    strict.limits.max_depth = 2;
+    strict.limits.max_memory = 4096;
+    RegexOptions big_cache;
+    big_cache.shared_dfa = true;
+    big_cache.shared_dfa_budget = 64 * 1024 * 1024;
+    bool limits_ok = rejected_for("((a{100}){100}){100}", {}) == static_cast<int>(CompileError::Kind::STATES) &&
+                     rejected_for("(((a)))", strict) == static_cast<int>(CompileError::Kind::DEPTH) &&
+                     rejected_for("[a-z]{200}", strict) == static_cast<int>(CompileError::Kind::MEMORY) &&
+                     rejected_for("ab", big_cache) == static_cast<int>(CompileError::Kind::DFA_CACHE) &&
+                     rejected_for("((a))[a-z]{100}", strict) == -1 && Regex(".{0,4096}x").is_match("abcx");
+    // Sets are checked per pattern and as a whole
+    auto set_rejected_for = [](const vector<std::string> &patterns, const CompileLimits &limits){
+        try{
+            RegexSet s(patterns, LazyDfa::DEFAULT_CACHE_BUDGET, limits);
+        }catch (const CompileError &e){
+            return static_cast<int>(e.kind);
+        }
+        return -1;
+    };
+    CompileLimits small_set;
+    small_set.max_states = 64;
+    limits_ok = limits_ok &&
+                set_rejected_for({"a", "((a{1000}){1000}){1000}"}, {}) == static_cast<int>(CompileError::Kind::STATES) &&
+                set_rejected_for({"(((a)))"}, strict.limits) == static_cast<int>(CompileError::Kind::DEPTH) &&
+                set_rejected_for({"a{30}", "b{30}", "c{30}"}, small_set) == static_cast<int>(CompileError::Kind::STATES) &&
+                set_rejected_for({"a{30}", "b{30}"}, small_set) == -1 &&
+                set_rejected_for({"a"}, CompileLimits{.max_dfa_cache = 1024}) == static_cast<int>(CompileError::Kind::DFA_CACHE);
+    std::cout << "Limits: " << (limits_ok ? "passed" : "FAILED") << "\n";
+
+    // Counted loops: a large count compiles to a loop whose size does not
+    // depend on it, and each engine answers as over the expanded program
+    auto counted_states = [](const std::string &pattern){ return NfaBuilder().build(Parser::parse(pattern), true, true).size(); };
+    Ast loop_ast = Parser::parse("(ab|a){2,300}(b)");
+    Program loop_prog = NfaBuilder().build(loop_ast, true, true);
+    Program loop_plain = NfaBuilder().build(loop_ast);
+    Program loop_expanded = NfaBuilder::expand(loop_prog);
+    PikeVM loop_vm(loop_prog), plain_vm(loop_plain), expanded_vm(loop_expanded);
+    Backtracker loop_bt(loop_prog);
+    bool counters_ok = counted_states(".{0,4096}") == counted_states(".{0,100000}") && counted_states("[a-z]{0,100000}") <= 4 &&
+                       loop_prog.size() < 20 && loop_plain.size() > 900 && rejected_for("(a|b){0,60000}", {}) == -1;
+    for (const std::string &input : {std::string("xaab"), "ab" + std::string(400, 'a') + "bb", std::string(299, 'a') + "abb"}){
+        Captures want, got_vm, got_bt, got_expanded;
+        bool found = plain_vm.search(input, &want);
+        counters_ok = counters_ok && loop_vm.search(input, &got_vm) == found && got_vm == want &&
+                      loop_bt.search(input, &got_bt) == found && got_bt == want &&
+                      expanded_vm.search(input, &got_expanded) == found && got_expanded == want;
+    }
+    Regex window("x.{300}y");
+    Captures window_caps;
+    std::string window_input = std::string(100, 'a') + "x" + std::string(300, 'b') + "yz";
+    StreamMatcher window_stream(window.program());
+    window_stream.feed(window_input.substr(0, 250));
+    window_stream.feed(window_input.substr(250));
+    window_stream.finish();
+    counters_ok = counters_ok && window.search(window_input, &window_caps) && window_caps == Captures{100, 402} &&
+                  !window.is_match(window_input.substr(1, 300)) && window.full_match(window_input.substr(100, 302)) &&
+                  Dfa::compile(window.program(), true).is_match(window_input.substr(100, 302)) && window_stream.match_end() == 402;
+    std::cout << "Counters: " << (counters_ok ? "passed" : "FAILED") << "\n";
+
+    // Optimizer: nested options collapse, dead branches and common tails go,
+    // unwanted captures are dropped. The two instances of (a?|b?c) can match
+    // the empty string and stay apart, or "c" would not be matched.
+    auto states_of = [](const std::string &pattern){ return NfaBuilder().build(Parser::parse(pattern), false).size(); };
+    Regex spans_only("(a+)(b+)", RegexOptions{.captures = false});
+    Regex empty_loop("(a?|b?c){1,}", RegexOptions{.captures = false});
+    Captures span_caps, loop_caps;
+    bool optimizer_ok = states_of("(a?)?b") == states_of("a?b") && states_of("a^b|c") == states_of("c") &&
+                        states_of("xab|yab") < NfaBuilder::estimate(Parser::parse("xab|yab")).states &&
+                        spans_only.num_groups() == 1 && spans_only.search("xaab", &span_caps) &&
+                        span_caps == Captures{1, 4} && empty_loop.search("c", &loop_caps) && loop_caps == Captures{0, 1};
+    std::cout << "Optimizer: " << (optimizer_ok ? "passed" : "FAILED") << "\n";
+
+    // Rewriter: shared prefixes are factored out and one-character
+    // alternatives become a class, without moving captures or literal routing
+    Regex shared_prefix("x(abc|abd)"), literals("error_x|error_y|error_z");
+    Captures prefix_caps;
+    bool rewriter_ok = states_of("abc|abd") == states_of("ab[cd]") && states_of("a|b|c") == states_of("[abc]") &&
+                       shared_prefix.search("_xabd", &prefix_caps) && prefix_caps == Captures{1, 5, 2, 5} &&
+                       literals.is_literal() && literals.is_match("an error_y here") && !literals.is_match("error_w");
+    std::cout << "Rewriter: " << (rewriter_ok ? "passed" : "FAILED") << "\n";
+    return passed == match_tcs.size() && persist_ok && set_passed == set_tcs.size() && literal_ok && onepass_ok && reverse_ok &&
+           suffix_ok && stream_ok && threads_ok && cache_ok && batch_ok && grep_ok && limits_ok && counters_ok && optimizer_ok && rewriter_ok ? 0 : 1;
 }
 
 // Result of tests:
@@ -189,5 +406,5 @@ int main(){
 // -> without the nfa printing, total time recorded by me to build these 200+ nfas was 100ms
 
 // compile and run the file:
-// g++ -std=c++20 -O2 -Wall -Wextra -Wpedantic -Wshadow -Wconversion testing.cpp tokenizer.cpp postfix.cpp nfa_builder.cpp -o testing.exe
+// g++ -std=c++20 -O2 -pthread -Wall -Wextra -Wpedantic -Wshadow -Wconversion testing.cpp tokenizer.cpp postfix.cpp parser.cpp ast_rewriter.cpp nfa_builder.cpp nfa_optimizer.cpp pike_vm.cpp lazy_dfa.cpp dfa.cpp byte_classes.cpp prefilter.cpp regex_set.cpp aho_corasick.cpp backtrack.cpp onepass.cpp regex.cpp stream_matcher.cpp shared_dfa.cpp regex_cache.cpp grep.cpp -o testing.exe
 // .\testing .exe
\ No newline at end of file
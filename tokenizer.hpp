@@ -3,7 +3,7 @@
 #include "std.hpp"
 #include<vector>
 
-enum class TokenType{
+enum class TokenType : uint8_t {
     // Literals
     LITERAL,
     DOT,
@@ -62,15 +62,18 @@ class Tokenizer{
     public:
     explicit Tokenizer(std::string_view pat);
     std::vector<Token> tokenize();
+    // One token at a time, for a parser that reads the pattern in a single
+    // pass (no END token, no CONCAT tokens)
+    Token next_token();
+    bool eof() const;
+    size_t position() const { return i; }
     private:
     std::string_view pattern;
     size_t i = 0;
     int group_counter = 0;
-    std::stack<int> group_stack;
+    std::stack<int, std::vector<int>> group_stack;
     char peek() const;
     char get();
-    bool eof() const;
-    Token next_token();
     Token read_literal(char);
     Token read_escape();
     Token read_char_class();